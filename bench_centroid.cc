@@ -0,0 +1,215 @@
+/* NaturalPoint Optitrack centroid accuracy and speed
+
+  Renders discs with known sub-pixel centers the way the camera
+  thresholds them (a pixel is set if its center lies inside the disc),
+  whole or cut off by the sensor border, encodes them into camera frames
+  with optitrack_encode() and runs them through optitrack_decode(),
+  optitrack_label() and every centroid method, plus the polygon through
+  the run edges for comparison.
+  The random sequence is fixed, so results only change with the code.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // exit() etc.
+#include <stdio.h>  // printf() etc.
+#include <math.h>   // sqrt() etc.
+#include <time.h>   // clock_gettime()
+#include <stdint.h> // uint64_t
+
+#include <vector>
+#include <algorithm>
+
+#include "centroid.h"
+
+#define FRAME_SIZE 4096
+#define FRAMES 200
+#define REPEAT 20
+
+struct disc { double x, y, r; };
+
+struct frame {
+	std::vector<disc> discs;
+	std::vector<unsigned char> data;
+};
+
+static const char* methods[] = { "moments", "edges", "circle" };
+
+optitrack_decoded decoded;
+optitrack_labels labels;
+optitrack_centroid centroids[OPTITRACK_MAX_BLOBS];
+
+/*
+  Centroid of the polygon through the run edges at the row centers, the
+  obvious way to interpolate between the thresholded run ends. Between
+  two rows with width w(t) = w0 + t*dw and center c(t) = c0 + t*dc for
+  t = 0 .. 1, each band is a trapezoid with area w0 + dw/2, x moment the
+  integral of w(t)*c(t) and y moment that of w(t)*t; the half rows above
+  the top and below the bottom row are rectangles. The runs don't say
+  how much of their end pixels the marker covers, so this ends up where
+  MOMENTS does, only slower, which is why it isn't in centroid.cc.
+*/
+static void edges(int b, optitrack_centroid* out) {
+
+	double area = 0, mx = 0, my = 0;
+	double y0 = -1, l0 = 0, r0 = 0; // previous row
+	double y1 = -1, l1 = 0, r1 = 0; // row being collected
+
+	auto row = [&]() {
+		double w1 = r1 - l1, c1 = (l1 + r1) / 2;
+		if (y0 < 0) {
+			area += w1 / 2; mx += w1 / 2 * c1; my += w1 / 2 * (y1 - 0.25);
+		} else {
+			double w0 = r0 - l0, c0 = (l0 + r0) / 2;
+			double dw = w1 - w0, dc = c1 - c0;
+			double a = w0 + dw / 2;
+			area += a;
+			mx += w0 * c0 + (w0 * dc + c0 * dw) / 2 + dw * dc / 3;
+			my += y0 * a + w0 / 2 + dw / 3;
+		}
+		y0 = y1; l0 = l1; r0 = r1;
+	};
+
+	// rows with several runs are treated as one
+	for (int k = labels.start[b]; k < labels.start[b+1]; k++) {
+		int i = labels.order[k];
+		if (y1 != decoded.y[i]) {
+			if (y1 >= 0) row();
+			y1 = decoded.y[i];
+			l1 = decoded.x1[i] - 0.5;
+			r1 = decoded.x2[i] - 0.5;
+		} else {
+			l1 = std::min(l1,decoded.x1[i] - 0.5);
+			r1 = std::max(r1,decoded.x2[i] - 0.5);
+		}
+	}
+	row();
+
+	double w = r0 - l0;
+	area += w / 2; mx += w / 2 * (l0 + r0) / 2; my += w / 2 * (y0 + 0.25);
+
+	out->x = mx / area;
+	out->y = my / area;
+	out->radius = sqrt(labels.blobs[b].area / M_PI);
+}
+
+// method m of methods[], edges only exists here
+static void centroids_of(int m) {
+	if (m == 1) for (int b = 0; b < labels.count; b++) edges(b,&centroids[b]);
+	else optitrack_centroids(&decoded,&labels,m ? OPTITRACK_CENTROID_CIRCLE : OPTITRACK_CENTROID_MOMENTS,centroids);
+}
+
+static uint32_t seed = 1;
+
+// uniform in 0 .. 1, same sequence everywhere
+static double uniform() {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) / 16777216.0;
+}
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// one frame of discs with radius r on a grid, jittered by up to a pixel,
+// or along the left sensor border with up to half of each disc cut off
+static frame render(double r, bool clipped) {
+
+	frame f;
+	std::vector<optitrack_scanline> lines;
+	int cell = 2 * ceil(r) + 4;
+	int per_frame = std::min(OPTITRACK_MAX_BLOBS / 2, (int)(800 / (2*r + 1)));
+
+	for (int gy = cell / 2; gy + cell / 2 <= OPTITRACK_MAX_Y; gy += cell) {
+		if (clipped) {
+			f.discs.push_back({ r * (0.1 + 0.9 * uniform()), gy + uniform(), r });
+			continue;
+		}
+		for (int gx = cell / 2; gx + cell / 2 <= OPTITRACK_MAX_X; gx += cell)
+			if ((int)f.discs.size() < per_frame) f.discs.push_back({ gx + uniform(), gy + uniform(), r });
+	}
+
+	for (const disc& d: f.discs)
+		for (int y = ceil(d.y - d.r); y <= floor(d.y + d.r); y++) {
+			double half = sqrt(d.r*d.r - (y - d.y)*(y - d.y));
+			int x1 = std::max(0.0,ceil(d.x - half)), x2 = floor(d.x + half) + 1;
+			if (x2 > x1) lines.push_back({ (short)y, (short)x1, (short)x2 });
+		}
+
+	// the camera sends rows top to bottom, left to right
+	std::sort(lines.begin(),lines.end(),[](const optitrack_scanline& a, const optitrack_scanline& b) {
+		return (a.y != b.y) ? (a.y < b.y) : (a.x1 < b.x1);
+	});
+
+	f.data.resize(FRAME_SIZE);
+	f.data.resize(optitrack_encode(lines.data(),lines.size(),f.data.data(),FRAME_SIZE));
+	if (f.data.empty()) { printf("frame too large for radius %.1f\n",r); exit(1); }
+
+	return f;
+}
+
+static void run(double r, bool clipped) {
+
+	std::vector<frame> frames;
+	for (int i = 0; i < FRAMES; i++) frames.push_back(render(r,clipped));
+
+	for (int m = 0; m < 3; m++) {
+
+		double sum = 0, worst = 0;
+		long blobs = 0, missed = 0;
+
+		for (const frame& f: frames) {
+
+			optitrack_decode(f.data.data(),f.data.size(),&decoded);
+			optitrack_label(&decoded,&labels);
+			centroids_of(m);
+
+			for (const disc& d: f.discs) {
+				double best = 1e9;
+				for (int b = 0; b < labels.count; b++) {
+					double dx = centroids[b].x - d.x, dy = centroids[b].y - d.y;
+					best = std::min(best,dx*dx + dy*dy);
+				}
+				if (best > d.r*d.r) { missed++; continue; }
+				sum += best; worst = std::max(worst,sqrt(best));
+				blobs++;
+			}
+		}
+
+		// time the centroid step alone, on already labeled frames
+		uint64_t elapsed = 0;
+		long timed = 0;
+		for (const frame& f: frames) {
+			optitrack_decode(f.data.data(),f.data.size(),&decoded);
+			optitrack_label(&decoded,&labels);
+			uint64_t start = now();
+			for (int i = 0; i < REPEAT; i++) centroids_of(m);
+			elapsed += now() - start;
+			timed += REPEAT * labels.count;
+		}
+
+		printf("  %s r %5.1f  %-8s  rms %.4f px  max %.4f px  %7.1f ns/blob",
+			clipped ? "clipped" : "whole  ",r,methods[m],sqrt(sum / blobs),worst,(double)elapsed / timed);
+		if (missed) printf("  (%ld missed)",missed);
+		printf("\n");
+	}
+}
+
+int main(int argc, char* argv[]) {
+
+	static const double radii[] = { 1.5, 2.5, 4, 6, 10, 16 };
+
+	printf("%d frames per radius, error against the rendered disc centers\n",FRAMES);
+	for (double r: radii) run(r,false);
+	for (double r: radii) if (r >= 4) run(r,true);
+
+	return 0;
+}
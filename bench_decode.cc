@@ -0,0 +1,192 @@
+/* NaturalPoint Optitrack frame decoder benchmark
+
+  Compares the per-record loop (optitrack_parse(), as used by the viewer)
+  with every decoder this CPU supports, on the recorded frame from
+  test.txt, on synthetic dense frames and on raw dumps given on the
+  command line. All decoders are checked against optitrack_parse() and
+  the scalar decoder first.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // exit() etc.
+#include <string.h> // memcpy() etc.
+#include <stdio.h>  // printf() etc.
+#include <time.h>   // clock_gettime()
+#include <stdint.h> // uint64_t
+
+#include <vector>
+
+#include "decode.h"
+
+#define FRAME_SIZE 4096
+#define SYNTHETIC 64
+
+// minimum time spent on each decoder and data set, in ns
+#define BENCH_TIME 200000000ULL
+
+typedef std::vector<unsigned char> frame_t;
+
+// the frame from test.txt
+static const unsigned char recorded[] = {
+	62, 28,
+	13, 159, 166, 32,  14, 157, 167, 32,  15, 156, 168, 32,  16, 155, 169, 32,
+	17, 155, 170, 32,  18, 154, 170, 32,  19, 154, 170, 32,  20, 154, 170, 32,
+	21, 154, 170, 32,  22, 154, 170, 32,  23, 154, 170, 32,  24, 155, 169, 32,
+	25, 155, 169, 32,  26, 156, 168, 32,  27, 157, 167, 32,
+	127, 87, 14, 28,
+	28, 159, 165, 32,  29, 162, 163, 32,
+	0, 0, 0, 0
+};
+
+optitrack_scanline lines[OPTITRACK_MAX_LINES];
+optitrack_decoded decoded, reference;
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// frame packed with as many random scanlines as fit into one bulk transfer
+static frame_t dense_frame() {
+
+	optitrack_scanline src[OPTITRACK_MAX_LINES];
+	frame_t frame(FRAME_SIZE);
+
+	for (int i = 0; i < OPTITRACK_MAX_LINES; i++) {
+		src[i].y  = random() % (OPTITRACK_MAX_Y + 1);
+		src[i].x1 = random() % (OPTITRACK_MAX_X - 16);
+		src[i].x2 = src[i].x1 + 1 + random() % 16;
+	}
+
+	for (int count = OPTITRACK_MAX_LINES; count > 0; count--) {
+		int length = optitrack_encode(src,count,frame.data(),FRAME_SIZE);
+		if (length) { frame.resize(length); break; }
+	}
+
+	return frame;
+}
+
+// split a raw dump into frames at the end records
+static void load(const char* path, std::vector<frame_t>& frames) {
+
+	FILE* f = fopen(path,"rb");
+	if (!f) { perror(path); exit(1); }
+
+	frame_t data;
+	unsigned char buffer[FRAME_SIZE];
+	size_t count;
+	while ((count = fread(buffer,1,sizeof(buffer),f)) > 0) data.insert(data.end(),buffer,buffer+count);
+	fclose(f);
+
+	// a frame ends after its end record, or when it fills a whole transfer
+	for (size_t start = 0; start + OPTITRACK_RECORD_START < data.size(); ) {
+		size_t end = start + OPTITRACK_RECORD_START;
+		while ((end + OPTITRACK_RECORD_SIZE <= data.size()) && (end + OPTITRACK_RECORD_SIZE - start <= FRAME_SIZE)) {
+			const unsigned char* r = &data[end];
+			end += OPTITRACK_RECORD_SIZE;
+			if (!(r[0] | r[1] | r[2] | r[3])) break;
+		}
+		frames.push_back(frame_t(data.begin()+start,data.begin()+end));
+		start = end;
+	}
+}
+
+static void check(const char* name, optitrack_decoder decoder, const std::vector<frame_t>& frames) {
+
+	for (size_t f = 0; f < frames.size(); f++) {
+
+		optitrack_scanlines ref = optitrack_parse(frames[f].data(),frames[f].size(),lines,OPTITRACK_MAX_LINES);
+		optitrack_decoder_get("scalar")(frames[f].data(),frames[f].size(),&reference);
+		decoder(frames[f].data(),frames[f].size(),&decoded);
+
+		bool ok = (ref.count == decoded.count) && (ref.out_of_range == decoded.out_of_range);
+		for (int i = 0; ok && i < ref.count; i++)
+			ok = (lines[i].y == decoded.y[i]) && (lines[i].x1 == decoded.x1[i]) && (lines[i].x2 == decoded.x2[i]);
+
+		ok = ok && (reference.marker_count == decoded.marker_count);
+		for (int i = 0; ok && i < reference.marker_count; i++)
+			ok = (reference.markers[i] == decoded.markers[i]);
+
+		if (!ok) {
+			printf("%s: frame %zu differs from optitrack_parse()\n",name,f);
+			exit(1);
+		}
+	}
+}
+
+// ns per frame, repeats the set for at least BENCH_TIME
+static double bench(optitrack_decoder decoder, const std::vector<frame_t>& frames, long* sink) {
+
+	uint64_t start = now(), elapsed;
+	long rounds = 0;
+
+	do {
+		for (const frame_t& frame: frames) {
+			if (decoder) {
+				decoder(frame.data(),frame.size(),&decoded);
+				*sink += decoded.count + decoded.y[0];
+			} else {
+				optitrack_scanlines result = optitrack_parse(frame.data(),frame.size(),lines,OPTITRACK_MAX_LINES);
+				*sink += result.count + lines[0].y;
+			}
+		}
+		rounds++;
+	} while ((elapsed = now() - start) < BENCH_TIME);
+
+	return (double)elapsed / (rounds * frames.size());
+}
+
+static void run(const char* title, const std::vector<frame_t>& frames) {
+
+	static const char* names[] = { "scalar", "sse2", "avx2" };
+	long sink = 0, records = 0;
+
+	if (frames.empty()) return;
+
+	for (const frame_t& frame: frames) records += (frame.size() - OPTITRACK_RECORD_START) / OPTITRACK_RECORD_SIZE;
+	printf("%s: %zu frames, %.1f records/frame\n",title,frames.size(),(double)records/frames.size());
+
+	double base = bench(0,frames,&sink);
+	printf("  %-16s %9.1f ns/frame %7.2f ns/record\n","optitrack_parse",base,base*frames.size()/records);
+
+	for (const char* name: names) {
+		optitrack_decoder decoder = optitrack_decoder_get(name);
+		if (!decoder) { printf("  %-16s not supported\n",name); continue; }
+		check(name,decoder,frames);
+		double t = bench(decoder,frames,&sink);
+		printf("  %-16s %9.1f ns/frame %7.2f ns/record %5.2fx\n",name,t,t*frames.size()/records,base/t);
+	}
+
+	if (sink == 42) printf("\n"); // keep the results alive
+}
+
+int main(int argc, char* argv[]) {
+
+	std::vector<frame_t> frames;
+
+	srandom(1);
+	printf("optitrack_decode() uses %s\n",optitrack_decoder_name());
+
+	frames.push_back(frame_t(recorded,recorded+sizeof(recorded)));
+	run("recorded (test.txt)",frames);
+
+	frames.clear();
+	for (int i = 0; i < SYNTHETIC; i++) frames.push_back(dense_frame());
+	run("synthetic dense",frames);
+
+	for (int i = 1; i < argc; i++) {
+		frames.clear();
+		load(argv[i],frames);
+		run(argv[i],frames);
+	}
+
+	return 0;
+}
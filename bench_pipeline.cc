@@ -0,0 +1,172 @@
+/* NaturalPoint Optitrack processing pipeline benchmark
+
+  Runs frames from a replay source through the capture API and every
+  processing stage (decode, label, centroids), without a camera:
+  synthetic markers by default, or a recording (see record.h) or raw
+  stream given on the command line. Frames are processed on the capture
+  thread, so with -f 0 / -x 0 the source runs exactly as fast as the
+  pipeline. Prints the time spent per stage, the latency from delivery
+  to centroids and a checksum of all centroids, which only changes with
+  the input or the code. With -o, the frames are also written to a
+  recording; replaying that at any speed gives the same checksum.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // atoi() etc.
+#include <stdio.h>  // printf() etc.
+#include <time.h>   // clock_gettime()
+#include <stdint.h> // uint64_t
+#include <unistd.h> // getopt()
+
+#include "capture.h"
+#include "centroid.h"
+#include "record.h"
+
+enum { DECODE, LABEL, CENTROID, LATENCY, STAGES };
+static const char* names[STAGES] = { "decode", "label", "centroid", "latency" };
+
+struct stage { uint64_t total, worst; };
+
+struct state {
+	int method;
+	long frames, blobs, dropped, bytes;
+	stage stages[STAGES];
+	uint32_t checksum;
+	recorder* rec; // frames are written here too, if set
+	optitrack_decoded decoded;
+	optitrack_labels labels;
+	optitrack_centroid centroids[OPTITRACK_MAX_BLOBS];
+};
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void account(state* s, int n, uint64_t elapsed) {
+	s->stages[n].total += elapsed;
+	if (elapsed > s->stages[n].worst) s->stages[n].worst = elapsed;
+}
+
+// FNV-1a over the raw bits, so any change in any centroid shows
+static void checksum(state* s, const void* data, size_t size) {
+	for (size_t i = 0; i < size; i++)
+		s->checksum = (s->checksum ^ ((const unsigned char*)data)[i]) * 16777619;
+}
+
+static void process(const struct optitrack_frame* header, const unsigned char* data, void* user) {
+
+	state* s = (state*)user;
+	uint64_t t0 = now();
+
+	optitrack_decode(data,header->length,&s->decoded);
+	uint64_t t1 = now();
+
+	optitrack_label(&s->decoded,&s->labels);
+	uint64_t t2 = now();
+
+	optitrack_centroids(&s->decoded,&s->labels,s->method,s->centroids);
+	uint64_t t3 = now();
+
+	account(s,DECODE,t1 - t0);
+	account(s,LABEL,t2 - t1);
+	account(s,CENTROID,t3 - t2);
+	account(s,LATENCY,t3 - header->timestamp);
+
+	checksum(s,s->centroids,s->labels.count * sizeof(optitrack_centroid));
+
+	// after the timing, so recording doesn't show up in the stages
+	if (s->rec && record_write(s->rec,0,header,data) < 0) {
+		fprintf(stderr,"unable to write the recording\n");
+		exit(1);
+	}
+
+	s->frames++;
+	s->blobs += s->labels.count;
+	s->dropped += header->dropped;
+	s->bytes += header->length;
+}
+
+void usage(const char* name) {
+	fprintf(stderr,"usage: %s [-m markers] [-n frames] [-s seed] [-f fps] [-x speed] [-c method] [-o out.rec] [file.rec|stream.raw]\n",name);
+	exit(1);
+}
+
+int main(int argc, char* argv[]) {
+
+	int markers = 20, frames = 10000, fps = 0, seed = 1;
+	double speed = 0;
+	const char* output = 0;
+	int opt;
+
+	static state s;
+	s.method = OPTITRACK_CENTROID_CIRCLE;
+	s.checksum = 2166136261u;
+
+	while ((opt = getopt(argc,argv,"m:n:s:f:x:c:o:")) != -1) {
+		switch (opt) {
+			case 'm': markers = atoi(optarg); break;
+			case 'n': frames = atoi(optarg); break;
+			case 's': seed = atoi(optarg); break;
+			case 'f': fps = atoi(optarg); break;
+			case 'x': speed = atof(optarg); break;
+			case 'c': s.method = atoi(optarg); break;
+			case 'o': output = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+
+	const char* path = (optind < argc) ? argv[optind] : 0;
+	struct capture* cap;
+
+	if (path) {
+		// a recording if it is one, a raw stream otherwise
+		cap = capture_open_replay(path,speed);
+		if (!cap) cap = capture_open_stream(path,fps);
+	} else
+		cap = capture_open_synthetic(markers,frames,fps,seed);
+
+	if (!cap) {
+		fprintf(stderr,"unable to open %s\n",path);
+		return 1;
+	}
+
+	if (output && !(s.rec = record_create(output,0))) {
+		perror(output);
+		return 1;
+	}
+
+	printf("source: %s, decoder: %s\n",path ? path : "synthetic",optitrack_decoder_name());
+
+	uint64_t start = now();
+	struct capture_frame frame;
+
+	capture_start(cap,process,&s);
+	while (capture_next(cap,&frame,1000) >= 0);
+	capture_close(cap);
+
+	if (s.rec && record_close(s.rec) < 0) {
+		fprintf(stderr,"unable to finish %s\n",output);
+		return 1;
+	}
+
+	double seconds = (now() - start) / 1e9;
+	if (!s.frames) { printf("no frames\n"); return 1; }
+
+	printf("%ld frames in %.3f s (%.0f fps), %.1f blobs and %.0f bytes per frame, %ld dropped\n",
+		s.frames,seconds,s.frames / seconds,(double)s.blobs / s.frames,(double)s.bytes / s.frames,s.dropped);
+
+	for (int n = 0; n < STAGES; n++)
+		printf("  %-8s  mean %8.2f us  max %8.2f us\n",names[n],s.stages[n].total / 1e3 / s.frames,s.stages[n].worst / 1e3);
+
+	printf("checksum %08x\n",s.checksum);
+	return 0;
+}
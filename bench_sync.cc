@@ -0,0 +1,222 @@
+/* NaturalPoint Optitrack frame synchronizer simulation
+
+  Simulates cameras running at 100 fps with their own clock drift,
+  exposure phase, USB latency and jitter and occasional lost frames, one
+  of them unplugged for a while in the middle. Frames are pushed in the
+  order they would arrive and polled at their arrival times, so every
+  run gives the same result.
+
+  Counts the sets for which some camera had another frame clearly closer
+  to the rest of the set than the one chosen (going by the timestamps
+  without jitter, per-camera latency can't be seen); these are mostly
+  near ties between two places to cut the sets. Compares the estimated
+  drift with the simulated one and reports the latency of the sets.
+  Then the same frames are pushed from one thread per camera, to measure
+  the ingest throughput.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // atoi() etc.
+#include <stdio.h>  // printf() etc.
+#include <math.h>   // fabs() etc.
+#include <time.h>   // clock_gettime()
+#include <unistd.h> // getopt()
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#include "sync.h"
+
+#define PERIOD 10000000.0 // ns, 100 fps
+#define MARGIN 1000000.0  // ns, closer by less counts as a tie
+
+struct simulated {
+	double drift, phase, latency, jitter; // ppm, ns, ns, ns
+};
+
+struct arrival {
+	uint64_t time;    // when the frame reaches the host, also its timestamp
+	double exposure;  // true exposure time
+	double ideal;     // timestamp without jitter, the best the synchronizer can know
+	int camera;
+	optitrack_frame header;
+};
+
+static uint32_t seed = 1;
+
+// uniform in 0 .. 1, same sequence everywhere
+static double uniform() {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) / 16777216.0;
+}
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usage(const char* name) {
+	fprintf(stderr,"usage: %s [-c cameras] [-n frames] [-l latency_ms] [-m min_cameras] [-s seed]\n",name);
+	exit(1);
+}
+
+int main(int argc, char* argv[]) {
+
+	int cameras = 8, frames = 20000, min_cameras = 2;
+	double latency = 20;
+	int opt;
+
+	while ((opt = getopt(argc,argv,"c:n:l:m:s:")) != -1) {
+		switch (opt) {
+			case 'c': cameras = atoi(optarg); break;
+			case 'n': frames = atoi(optarg); break;
+			case 'l': latency = atof(optarg); break;
+			case 'm': min_cameras = atoi(optarg); break;
+			case 's': seed = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if (cameras < 2 || cameras > TRIANGULATE_MAX_CAMERAS) usage(argv[0]);
+
+	// +-100 ppm, exposures up to 2 ms apart, 0.5 .. 2 ms on the bus plus up to 0.5 ms jitter
+	std::vector<simulated> sim(cameras);
+	for (simulated& s: sim) {
+		s.drift   = (uniform() - 0.5) * 200;
+		s.phase   = uniform() * 2000000;
+		s.latency = 500000 + uniform() * 1500000;
+		s.jitter  = 500000;
+	}
+
+	std::vector<arrival> arrivals;
+	optitrack_centroid centroid = { 100, 100, 3 };
+
+	for (int k = 0; k < cameras; k++) {
+		uint32_t sequence = 0, lost = 0;
+		for (int n = 0; n < frames; n++) {
+			// camera 1 is unplugged for a second, others lose 1% of their frames
+			if ((k == 1 && n >= frames / 2 && n < frames / 2 + 100) || uniform() < 0.01) { lost++; continue; }
+			arrival a;
+			a.exposure = 1e9 + n * PERIOD * (1 + sim[k].drift * 1e-6) + sim[k].phase;
+			a.ideal = a.exposure + sim[k].latency;
+			a.time = a.ideal + uniform() * sim[k].jitter;
+			a.camera = k;
+			a.header.timestamp = a.time;
+			a.header.sequence = sequence++;
+			a.header.length = 0;
+			a.header.dropped = lost;
+			a.header.blobs = 1;
+			lost = 0;
+			arrivals.push_back(a);
+		}
+	}
+
+	std::stable_sort(arrivals.begin(),arrivals.end(),[](const arrival& a, const arrival& b) { return a.time < b.time; });
+
+	// exposure and ideal timestamp of every queued frame by camera and sequence, to check the sets
+	std::vector<std::vector<double>> exposure(cameras), ideal(cameras);
+	for (const arrival& a: arrivals) {
+		exposure[a.camera].push_back(a.exposure);
+		ideal[a.camera].push_back(a.ideal);
+	}
+
+	synchronizer* sync = sync_create(cameras,latency * 1e6,min_cameras);
+	static sync_set set;
+	long sets = 0, wrong = 0;
+	std::vector<double> delays, spread;
+
+	for (const arrival& a: arrivals) {
+
+		sync_push(sync,a.camera,&a.header,&centroid,1);
+
+		while (sync_poll(sync,a.time,&set)) {
+
+			double first = 1e30, last = 0, sum = 0;
+			int count = 0;
+
+			for (int k = 0; k < cameras; k++) {
+				if (!(set.present & (1 << k))) continue;
+				double e = exposure[k][set.sequence[k]];
+				first = std::min(first,e); last = std::max(last,e);
+				sum += ideal[k][set.sequence[k]]; count++;
+			}
+
+			// wrong if another frame of some camera was clearly closer to the others
+			for (int k = 0; k < cameras && count > 1; k++) {
+				if (!(set.present & (1 << k))) continue;
+				const std::vector<double>& t = ideal[k];
+				uint32_t n = set.sequence[k];
+				double center = (sum - t[n]) / (count - 1);
+				if ((n > 0 && fabs(t[n-1] - center) + MARGIN < fabs(t[n] - center)) ||
+				    (n + 1 < t.size() && fabs(t[n+1] - center) + MARGIN < fabs(t[n] - center))) { wrong++; break; }
+			}
+
+			spread.push_back((last - first) / 1e6);
+			delays.push_back((a.time - first) / 1e6);
+			sets++;
+		}
+	}
+
+	sync_stats stats;
+	sync_get_stats(sync,&stats);
+
+	std::sort(delays.begin(),delays.end());
+	printf("%d cameras, %d frames each, latency bound %.1f ms, at least %d cameras per set\n",cameras,frames,latency,min_cameras);
+	printf("%lu sets, %lu partial, %lu dropped, %lu late frames, %lu resyncs, %ld with a better fitting frame\n",
+		stats.sets,stats.partial,stats.dropped,stats.late,stats.resync,wrong);
+	std::sort(spread.begin(),spread.end());
+	printf("exposures within a set: median %.2f ms, max %.2f ms apart\n",spread[spread.size() / 2],spread.back());
+	printf("exposure to set: median %.2f ms, 99%% %.2f ms, max %.2f ms\n",
+		delays[delays.size() / 2],delays[delays.size() * 99 / 100],delays.back());
+
+	double mean = 0;
+	for (const simulated& s: sim) mean += s.drift / cameras;
+
+	printf("camera  drift ppm (estimated)  offset ms  jitter us\n");
+	for (int k = 0; k < cameras; k++) {
+		sync_clock clock;
+		sync_get_clock(sync,k,&clock);
+		printf("  %2d   %8.1f (%8.1f)   %8.3f   %8.1f\n",k,sim[k].drift - mean,clock.drift,clock.offset / 1e6,clock.jitter / 1e3);
+	}
+
+	sync_destroy(sync);
+
+	// the same frames from one thread per camera, polled as fast as possible
+	sync = sync_create(cameras,latency * 1e6,min_cameras);
+	std::atomic<int> running(cameras);
+	std::atomic<long> retries(0);
+	std::vector<std::thread> producers;
+	uint64_t start = now();
+
+	for (int k = 0; k < cameras; k++)
+		producers.push_back(std::thread([&,k] {
+			for (const arrival& a: arrivals) {
+				if (a.camera != k) continue;
+				while (sync_push(sync,k,&a.header,&centroid,1) < 0) { retries++; std::this_thread::yield(); }
+			}
+			running--;
+		}));
+
+	sets = 0;
+	while (running > 0 || sync_poll(sync,~0ULL,&set))
+		while (sync_poll(sync,~0ULL,&set)) sets++;
+
+	for (std::thread& t: producers) t.join();
+	double seconds = (now() - start) / 1e9;
+
+	printf("threaded: %.0f frames/s pushed, %ld sets, %ld pushes found the queue full\n",
+		arrivals.size() / seconds,sets,(long)retries);
+
+	sync_destroy(sync);
+	return 0;
+}
@@ -0,0 +1,211 @@
+/* NaturalPoint Optitrack rigid-body tracking benchmark
+
+  Simulates rigid bodies of 4 to 6 markers flying and turning through a
+  2 m cube, plus loose markers that belong to no body, with noise and
+  occlusion as triangulation would deliver them. Every body count is run
+  twice: tracked with the predicted windows, and with a full search in
+  every frame as a frame-by-frame matcher would do it. Prints the time
+  per frame, how often the bodies were tracked and the position error.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // atoi() etc.
+#include <stdio.h>  // printf() etc.
+#include <math.h>   // sin() etc.
+#include <time.h>   // clock_gettime()
+#include <unistd.h> // getopt()
+
+#include <vector>
+#include <algorithm>
+
+#include "track.h"
+
+#define GATE 10.0     // mm
+#define LOST 5        // frames
+#define NOISE 0.5     // mm
+#define OCCLUSION 0.05
+
+struct simulated {
+	int count;
+	float marker[TRACK_MAX_MARKERS][3];
+	double center[3], amplitude[3], frequency[3]; // Lissajous path
+	double axis[3], speed;                         // constant turn
+};
+
+static uint32_t seed = 1;
+
+// uniform in 0 .. 1, same sequence everywhere
+static double uniform() {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) / 16777216.0;
+}
+
+static double normal() {
+	double sum = 0;
+	for (int i = 0; i < 12; i++) sum += uniform();
+	return sum - 6;
+}
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// rotation by angle around a unit axis, Rodrigues' formula
+static void turn(const double* axis, double angle, const float* v, double* out) {
+	double c = cos(angle), s = sin(angle), d = axis[0]*v[0] + axis[1]*v[1] + axis[2]*v[2];
+	double cross[3] = { axis[1]*v[2] - axis[2]*v[1], axis[2]*v[0] - axis[0]*v[2], axis[0]*v[1] - axis[1]*v[0] };
+	for (int k = 0; k < 3; k++) out[k] = v[k]*c + cross[k]*s + axis[k]*d*(1 - c);
+}
+
+static simulated make_body() {
+
+	simulated b;
+	b.count = 4 + (int)(uniform() * 3);
+
+	// markers 40 .. 80 mm from the center and at least 20 mm apart
+	for (int i = 0; i < b.count; i++) {
+		bool ok;
+		do {
+			double r = 40 + 40 * uniform(), d[3] = { normal(), normal(), normal() };
+			double n = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+			for (int k = 0; k < 3; k++) b.marker[i][k] = d[k] / n * r;
+			ok = true;
+			for (int j = 0; j < i; j++) {
+				double dx = b.marker[i][0]-b.marker[j][0], dy = b.marker[i][1]-b.marker[j][1], dz = b.marker[i][2]-b.marker[j][2];
+				if (dx*dx + dy*dy + dz*dz < 400) ok = false;
+			}
+		} while (!ok);
+	}
+
+	for (int k = 0; k < 3; k++) {
+		b.center[k] = (k == 2 ? 1000 : 0) + (uniform() - 0.5) * 800;
+		b.amplitude[k] = 200 + 400 * uniform();
+		b.frequency[k] = 0.1 + 0.4 * uniform(); // Hz, up to about 1.5 m/s
+	}
+
+	double a[3] = { normal(), normal(), normal() }, n = sqrt(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
+	for (int k = 0; k < 3; k++) b.axis[k] = a[k] / n;
+	b.speed = 0.5 + 2 * uniform(); // rad/s
+
+	return b;
+}
+
+// world position of a body's origin and markers at time t
+static void place(const simulated& b, double t, double* origin, double (*markers)[3]) {
+	for (int k = 0; k < 3; k++) origin[k] = b.center[k] + b.amplitude[k] * sin(2 * M_PI * b.frequency[k] * t + k);
+	for (int i = 0; i < b.count; i++) {
+		turn(b.axis,b.speed * t,b.marker[i],markers[i]);
+		for (int k = 0; k < 3; k++) markers[i][k] += origin[k];
+	}
+}
+
+// run frames through a tracker, full = search for every body in every frame
+static void run(const std::vector<simulated>& bodies, int loose, int frames, bool full) {
+
+	tracker* tr = track_create(GATE,LOST);
+	for (const simulated& b: bodies) track_add_body(tr,b.marker,b.count);
+
+	static triangulate_result points;
+	uint64_t elapsed = 0;
+	long tracked = 0, samples = 0, markers = 0;
+	double sum = 0;
+
+	for (int f = 0; f < frames; f++) {
+
+		double t = f * 0.01, origin[TRACK_MAX_BODIES][3], m[TRACK_MAX_MARKERS][3];
+		points.timestamp = f * 10000000ULL;
+		points.count = 0;
+
+		for (size_t i = 0; i < bodies.size(); i++) {
+			place(bodies[i],t,origin[i],m);
+			for (int j = 0; j < bodies[i].count; j++) {
+				if (uniform() < OCCLUSION || points.count == TRIANGULATE_MAX_POINTS) continue;
+				triangulate_point& p = points.points[points.count++];
+				p.x = m[j][0] + normal() * NOISE; p.y = m[j][1] + normal() * NOISE; p.z = m[j][2] + normal() * NOISE;
+			}
+		}
+
+		for (int i = 0; i < loose && points.count < TRIANGULATE_MAX_POINTS; i++) {
+			triangulate_point& p = points.points[points.count++];
+			p.x = (uniform() - 0.5) * 2000; p.y = (uniform() - 0.5) * 2000; p.z = uniform() * 2000;
+		}
+
+		// triangulation doesn't keep any order
+		for (int i = points.count - 1; i > 0; i--) std::swap(points.points[i],points.points[(int)(uniform() * (i + 1))]);
+		markers += points.count;
+
+		if (full) track_reset(tr);
+
+		uint64_t start = now();
+		track_update(tr,&points);
+		elapsed += now() - start;
+
+		for (size_t i = 0; i < bodies.size(); i++) {
+			track_body b;
+			track_get_body(tr,i,&b);
+			samples++;
+			if (!b.tracked || !b.markers) continue;
+			tracked++;
+			double d = 0;
+			for (int k = 0; k < 3; k++) d += (b.position[k] - origin[i][k]) * (b.position[k] - origin[i][k]);
+			sum += d;
+		}
+	}
+
+	track_stats stats;
+	track_get_stats(tr,&stats);
+
+	printf("  %2zu bodies %5.1f points  %-6s  %8.1f us/frame  tracked %5.1f%%  rms %.2f mm  %lu searches, %lu lost\n",
+		bodies.size(),(double)markers / frames,full ? "search" : "gated",elapsed / 1e3 / frames,
+		100.0 * tracked / samples,sqrt(sum / std::max(tracked,1L)),stats.searched,stats.lost);
+
+	track_destroy(tr);
+}
+
+void usage(const char* name) {
+	fprintf(stderr,"usage: %s [-b max_bodies] [-l loose] [-n frames] [-s seed]\n",name);
+	exit(1);
+}
+
+int main(int argc, char* argv[]) {
+
+	int max_bodies = 10, loose = 8, frames = 2000;
+	int opt;
+
+	while ((opt = getopt(argc,argv,"b:l:n:s:")) != -1) {
+		switch (opt) {
+			case 'b': max_bodies = atoi(optarg); break;
+			case 'l': loose = atoi(optarg); break;
+			case 'n': frames = atoi(optarg); break;
+			case 's': seed = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if (max_bodies > TRACK_MAX_BODIES) max_bodies = TRACK_MAX_BODIES;
+
+	std::vector<simulated> all;
+	for (int i = 0; i < max_bodies; i++) all.push_back(make_body());
+
+	printf("%d frames at 100 fps, %d loose markers, gate %.0f mm\n",frames,loose,GATE);
+
+	for (int n = 1; n <= max_bodies; n *= 2) {
+		std::vector<simulated> bodies(all.begin(),all.begin() + n);
+		uint32_t start = seed;
+		run(bodies,loose,frames,false);
+		seed = start;
+		run(bodies,loose,frames,true);
+		if (n < max_bodies && n * 2 > max_bodies) n = max_bodies / 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,132 @@
+/* NaturalPoint Optitrack triangulation benchmark
+
+  Generates a synthetic scene (see scene.h), triangulates every frame on
+  one thread to measure the latency per frame and the accuracy against
+  the true marker positions, then in batches on 1 .. threads threads to
+  measure the throughput.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // atoi() etc.
+#include <stdio.h>  // printf() etc.
+#include <math.h>   // sqrt() etc.
+#include <time.h>   // clock_gettime()
+#include <unistd.h> // getopt()
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+#include "scene.h"
+
+#define BATCH 64
+#define MATCH 10.0 // mm, further from every true marker counts as a ghost
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usage(const char* name) {
+	fprintf(stderr,"usage: %s [-c cameras] [-m markers] [-n frames] [-t threads] [-e tolerance] [-v min_views] [-s seed]\n",name);
+	exit(1);
+}
+
+int main(int argc, char* argv[]) {
+
+	int cameras = 8, markers = 32, frames = 2000, seed = 1, min_views = 3;
+	int threads = std::thread::hardware_concurrency();
+	float tolerance = 1.5;
+	int opt;
+
+	while ((opt = getopt(argc,argv,"c:m:n:t:e:v:s:")) != -1) {
+		switch (opt) {
+			case 'c': cameras = atoi(optarg); break;
+			case 'm': markers = atoi(optarg); break;
+			case 'n': frames = atoi(optarg); break;
+			case 't': threads = atoi(optarg); break;
+			case 'e': tolerance = atof(optarg); break;
+			case 'v': min_views = atoi(optarg); break;
+			case 's': seed = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if (threads < 1) threads = 1;
+
+	static scene s;
+	scene_create(&s,cameras,markers,seed);
+
+	std::vector<triangulate_set> sets(frames);
+	std::vector<triangulate_result> results(frames);
+	std::vector<float> truth(frames * SCENE_MAX_MARKERS * 3);
+	for (int f = 0; f < frames; f++) scene_step(&s,&sets[f],(float(*)[3])&truth[f * SCENE_MAX_MARKERS * 3]);
+
+	printf("%d cameras, %d markers, %d frames, tolerance %.1f px, %d views needed\n",s.cameras,s.markers,frames,tolerance,min_views);
+
+	triangulator* tri = triangulate_create(s.camera,s.cameras,tolerance,min_views,1);
+	if (!tri) { fprintf(stderr,"need 2 .. %d cameras\n",TRIANGULATE_MAX_CAMERAS); return 1; }
+
+	// latency and accuracy, one frame at a time
+	std::vector<uint64_t> latency(frames);
+	long found = 0, ghosts = 0, views = 0;
+	double sum = 0;
+
+	for (int f = 0; f < frames; f++) {
+
+		uint64_t start = now();
+		triangulate_frame(tri,&sets[f],&results[f]);
+		latency[f] = now() - start;
+
+		const float* t = &truth[f * SCENE_MAX_MARKERS * 3];
+		for (int p = 0; p < results[f].count; p++) {
+			const triangulate_point& point = results[f].points[p];
+			double best = 1e30;
+			for (int m = 0; m < s.markers; m++) {
+				double dx = point.x - t[m*3], dy = point.y - t[m*3+1], dz = point.z - t[m*3+2];
+				best = std::min(best,dx*dx + dy*dy + dz*dz);
+			}
+			if (best > MATCH * MATCH) { ghosts++; continue; }
+			found++; sum += best; views += point.views;
+		}
+	}
+
+	triangulate_destroy(tri);
+
+	std::sort(latency.begin(),latency.end());
+	printf("found %.1f%% of markers, rms error %.2f mm, %.1f views per point, %ld ghosts\n",
+		100.0 * found / ((long)frames * s.markers),sqrt(sum / std::max(found,1L)),(double)views / std::max(found,1L),ghosts);
+	printf("latency per frame: median %.1f us, 99%% %.1f us, max %.1f us\n",
+		latency[frames / 2] / 1e3,latency[frames * 99 / 100] / 1e3,latency[frames - 1] / 1e3);
+
+	// throughput in batches, for powers of two and then all threads
+	std::vector<int> counts;
+	for (int t = 1; t < threads; t *= 2) counts.push_back(t);
+	counts.push_back(threads);
+
+	for (int t: counts) {
+
+		tri = triangulate_create(s.camera,s.cameras,tolerance,min_views,t);
+
+		long points = 0;
+		uint64_t start = now();
+		for (int f = 0; f < frames; f += BATCH)
+			triangulate_frames(tri,&sets[f],&results[f],std::min(BATCH,frames - f));
+		double seconds = (now() - start) / 1e9;
+
+		for (int f = 0; f < frames; f++) points += results[f].count;
+		printf("  %2d threads: %8.0f frames/s  %10.0f points/s\n",t,frames / seconds,points / seconds);
+
+		triangulate_destroy(tri);
+	}
+
+	return 0;
+}
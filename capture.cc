@@ -0,0 +1,556 @@
+/* NaturalPoint Optitrack userspace capture
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // malloc() etc.
+#include <string.h> // memcpy() etc.
+#include <stdio.h>  // fprintf() etc.
+#include <time.h>   // clock_gettime()
+
+#include <unistd.h> // read()
+#include <fcntl.h>  // open()
+
+#include <math.h>   // sqrt() etc.
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+#ifndef CAPTURE_NO_USB
+#include <libusb.h>
+#endif
+
+#include "capture.h"
+#include "protocol.h"
+#include "record.h"
+
+#define ID_NATURALPOINT 0x131D
+#define ID_OPTITRACK    0x0125
+
+#define EP_IN  0x82
+#define EP_OUT 0x02
+
+// timeout for commands and for the info reply, in ms
+#define CMD_TIMEOUT 200
+#define INFO_TIMEOUT 1000
+
+struct capture {
+
+	// backend, run() loops on the event thread while running is set
+	void (*run)(struct capture* cap);
+	void (*release)(struct capture* cap);
+
+	std::thread thread;
+	std::atomic<bool> running;
+
+	capture_callback callback;
+	void* user;
+
+	uint32_t sequence; // next frame number
+	uint32_t lost;     // failed transfers since the last frame
+
+	// queue for capture_next(), overwrites the oldest frame when full
+	std::mutex lock;
+	std::condition_variable cond;
+	struct capture_frame* queue;
+	unsigned int head, tail, missed;
+	bool finished;
+
+#ifndef CAPTURE_NO_USB
+	// libusb backend
+	libusb_context* ctx;
+	libusb_device_handle* handle;
+	libusb_transfer** transfers;
+	int count;
+	std::atomic<int> active;
+	std::vector<libusb_transfer*> stalled; // waiting for the halt to be cleared, event thread only
+#endif
+
+	// stream and synthetic backends
+	int fd;
+	int fps;
+
+	// replay backend
+	struct recording* recording;
+	double speed;
+
+	// synthetic backend
+	struct marker { double x, y, vx, vy, r; };
+	std::vector<marker> markers;
+	int frames;
+	uint32_t seed;
+};
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// hand one frame to the callback or the queue
+static void deliver(struct capture* cap, const unsigned char* data, int length, uint64_t timestamp) {
+
+	struct optitrack_frame header;
+
+	if (length > CAPTURE_FRAME_SIZE) length = CAPTURE_FRAME_SIZE;
+
+	header.timestamp = timestamp;
+	header.sequence  = cap->sequence++;
+	header.length    = length;
+	header.dropped   = cap->lost;
+	header.blobs     = 0;
+	cap->lost = 0;
+
+	if (cap->callback) {
+		cap->callback(&header,data,cap->user);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(cap->lock);
+
+		if (cap->head - cap->tail >= CAPTURE_QUEUE_SIZE) {
+			cap->tail++;
+			cap->missed++;
+		}
+
+		struct capture_frame* frame = &cap->queue[cap->head % CAPTURE_QUEUE_SIZE];
+		frame->header = header;
+		memcpy(frame->data,data,length);
+		cap->head++;
+	}
+
+	cap->cond.notify_one();
+}
+
+static void finish(struct capture* cap) {
+	{
+		std::lock_guard<std::mutex> guard(cap->lock);
+		cap->finished = true;
+	}
+	cap->cond.notify_all();
+}
+
+// sleep until deadline, in now() nanoseconds
+static void wait_until(uint64_t deadline) {
+	struct timespec ts = { (time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL) };
+	clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL);
+}
+
+static struct capture* capture_alloc() {
+	struct capture* cap = new capture();
+	cap->queue = new capture_frame[CAPTURE_QUEUE_SIZE];
+	cap->fd = -1;
+	return cap;
+}
+
+
+#ifndef CAPTURE_NO_USB
+
+// libusb-1.0 backend
+
+static int command(struct capture* cap, optitrack_command cmd) {
+	int sent = 0;
+	return libusb_bulk_transfer(cap->handle,EP_OUT,cmd.data,cmd.size,&sent,CMD_TIMEOUT);
+}
+
+// ask for the info reply and wait for it instead of sleeping
+static int query_info(struct capture* cap) {
+
+	unsigned char buffer[CAPTURE_FRAME_SIZE];
+	uint64_t deadline = now() + INFO_TIMEOUT * 1000000ULL;
+	int result, count;
+
+	result = command(cap,optitrack_get_info());
+	if (result < 0) return result;
+
+	while (now() < deadline) {
+		result = libusb_bulk_transfer(cap->handle,EP_IN,buffer,sizeof(buffer),&count,CMD_TIMEOUT);
+		if ((result < 0) && (result != LIBUSB_ERROR_TIMEOUT)) return result;
+		if (count == OPTITRACK_INFO_SIZE) {
+			fprintf(stderr,"camera serial %d\n",(buffer[5] << 8) + buffer[6]);
+			return 0;
+		}
+	}
+
+	return LIBUSB_ERROR_TIMEOUT;
+}
+
+static void LIBUSB_CALL transfer_done(struct libusb_transfer* transfer) {
+
+	struct capture* cap = (struct capture*)transfer->user_data;
+	uint64_t timestamp = now();
+
+	switch (transfer->status) {
+		case LIBUSB_TRANSFER_COMPLETED:
+			if (transfer->actual_length > 0)
+				deliver(cap,transfer->buffer,transfer->actual_length,timestamp);
+			break;
+		case LIBUSB_TRANSFER_CANCELLED:
+		case LIBUSB_TRANSFER_NO_DEVICE:
+			cap->active--;
+			return;
+		case LIBUSB_TRANSFER_STALL:
+			// resubmitting would just stall again, usb_run() clears the halt first
+			cap->lost++;
+			cap->stalled.push_back(transfer);
+			return;
+		default:
+			cap->lost++;
+	}
+
+	if (!cap->running || (libusb_submit_transfer(transfer) < 0))
+		cap->active--;
+}
+
+static void usb_run(struct capture* cap) {
+
+	struct timeval tv = { 0, 100000 };
+
+	for (int i = 0; i < cap->count; i++)
+		if (libusb_submit_transfer(cap->transfers[i]) == 0)
+			cap->active++;
+
+	command(cap,optitrack_start());
+
+	// keep handling events until all transfers have come back
+	while (cap->active > 0) {
+
+		libusb_handle_events_timeout_completed(cap->ctx,&tv,NULL);
+
+		// can't be done in the callback, clearing the halt is a synchronous transfer
+		if (!cap->stalled.empty()) {
+			if (cap->running) libusb_clear_halt(cap->handle,EP_IN);
+			for (libusb_transfer* transfer: cap->stalled)
+				if (!cap->running || (libusb_submit_transfer(transfer) < 0))
+					cap->active--;
+			cap->stalled.clear();
+		}
+
+		if (!cap->running)
+			for (int i = 0; i < cap->count; i++)
+				libusb_cancel_transfer(cap->transfers[i]);
+	}
+
+	command(cap,optitrack_stop());
+	finish(cap);
+}
+
+static void usb_release(struct capture* cap) {
+
+	for (int i = 0; i < cap->count; i++) {
+		if (!cap->transfers[i]) continue;
+		free(cap->transfers[i]->buffer);
+		libusb_free_transfer(cap->transfers[i]);
+	}
+	delete[] cap->transfers;
+
+	if (cap->handle) {
+		command(cap,optitrack_set_led(0x00,0xF0));
+		libusb_release_interface(cap->handle,0);
+		libusb_close(cap->handle);
+	}
+	if (cap->ctx) libusb_exit(cap->ctx);
+}
+
+struct capture* capture_open_usb(int transfers) {
+
+	struct capture* cap = capture_alloc();
+
+	cap->run = usb_run;
+	cap->release = usb_release;
+
+	if (transfers < 1) transfers = 1;
+	cap->count = transfers;
+	cap->transfers = new libusb_transfer*[transfers]();
+
+	if (libusb_init(&cap->ctx) < 0) { cap->ctx = 0; goto fail; }
+
+	cap->handle = libusb_open_device_with_vid_pid(cap->ctx,ID_NATURALPOINT,ID_OPTITRACK);
+	if (!cap->handle) goto fail;
+	if (libusb_claim_interface(cap->handle,0) < 0) goto fail;
+
+	// same handshake as the kernel driver
+	if (command(cap,optitrack_reset(0x01)) < 0) goto fail;
+	if (command(cap,optitrack_set_led(0x00,0x80)) < 0) goto fail;
+	if (command(cap,optitrack_set_led(0x00,0x20)) < 0) goto fail;
+	if (query_info(cap) < 0) fprintf(stderr,"no reply to info command\n");
+	if (command(cap,optitrack_set_led(0xF0,0xF0)) < 0) goto fail;
+	if (command(cap,optitrack_reset(0x00)) < 0) goto fail;
+
+	for (int i = 0; i < transfers; i++) {
+		cap->transfers[i] = libusb_alloc_transfer(0);
+		if (!cap->transfers[i]) goto fail;
+		libusb_fill_bulk_transfer(cap->transfers[i],cap->handle,EP_IN,
+			(unsigned char*)malloc(CAPTURE_FRAME_SIZE),CAPTURE_FRAME_SIZE,transfer_done,cap,0);
+	}
+
+	return cap;
+
+fail:
+	capture_close(cap);
+	return 0;
+}
+
+#else
+
+struct capture* capture_open_usb(int transfers) {
+	fprintf(stderr,"built without libusb\n");
+	return 0;
+}
+
+#endif
+
+
+// recorded stream backend
+
+static void stream_run(struct capture* cap) {
+
+	unsigned char buffer[4*CAPTURE_FRAME_SIZE];
+	uint64_t next = now();
+	int fill = 0, count;
+	bool eof = false;
+
+	while (cap->running && (!eof || fill > 0)) {
+
+		if (!eof && fill < CAPTURE_FRAME_SIZE) {
+			count = read(cap->fd,buffer+fill,sizeof(buffer)-fill);
+			if (count <= 0) eof = true; else fill += count;
+		}
+
+		int length = optitrack_frame_length(buffer,fill,CAPTURE_FRAME_SIZE);
+		if (length == 0) {
+			if (!eof) continue;
+			length = fill; // trailing partial frame
+		}
+
+		// pace like a camera running at fps
+		if (cap->fps > 0) {
+			wait_until(next);
+			next += 1000000000ULL / cap->fps;
+		}
+
+		deliver(cap,buffer,length,now());
+
+		memmove(buffer,buffer+length,fill-length);
+		fill -= length;
+	}
+
+	finish(cap);
+}
+
+static void stream_release(struct capture* cap) {
+	if (cap->fd >= 0) close(cap->fd);
+}
+
+struct capture* capture_open_stream(const char* path, int fps) {
+
+	struct capture* cap = capture_alloc();
+
+	cap->run = stream_run;
+	cap->release = stream_release;
+	cap->fps = fps;
+
+	cap->fd = open(path,O_RDONLY);
+	if (cap->fd < 0) {
+		capture_close(cap);
+		return 0;
+	}
+
+	return cap;
+}
+
+
+// recording backend
+
+static void replay_run(struct capture* cap) {
+
+	uint64_t count = recording_count(cap->recording);
+	uint64_t start = now(), first = 0;
+
+	for (uint64_t n = 0; cap->running && n < count; n++) {
+
+		const record_frame* frame = recording_frame(cap->recording,n);
+		if (n == 0) first = frame->timestamp;
+
+		// same gaps between frames as when recorded, divided by speed
+		int64_t gap = frame->timestamp - first;
+		if (cap->speed > 0 && gap > 0)
+			wait_until(start + (uint64_t)(gap / cap->speed));
+
+		// frames the camera dropped back then count as lost now
+		cap->lost += frame->dropped;
+		deliver(cap,(const unsigned char*)(frame + 1),frame->length,now());
+	}
+
+	finish(cap);
+}
+
+static void replay_release(struct capture* cap) {
+	if (cap->recording) recording_close(cap->recording);
+}
+
+struct capture* capture_open_replay(const char* path, double speed) {
+
+	struct capture* cap = capture_alloc();
+
+	cap->run = replay_run;
+	cap->release = replay_release;
+	cap->speed = speed;
+
+	cap->recording = recording_open(path);
+	if (!cap->recording) {
+		capture_close(cap);
+		return 0;
+	}
+
+	return cap;
+}
+
+
+// synthetic backend
+
+// uniform in 0 .. 1, the same sequence for the same seed everywhere
+static double uniform(struct capture* cap) {
+	cap->seed = cap->seed * 1664525 + 1013904223;
+	return (cap->seed >> 8) / 16777216.0;
+}
+
+/*
+  Markers are discs moving in straight lines and bouncing off the sensor
+  border. A pixel is set if its center lies inside a disc, overlapping
+  discs merge into one run per row, as the camera would send them.
+*/
+static int render(struct capture* cap, unsigned char* frame) {
+
+	std::vector<optitrack_scanline> lines;
+
+	for (capture::marker& m: cap->markers) {
+
+		for (int y = std::max(0.0,ceil(m.y - m.r)); y <= std::min((double)OPTITRACK_MAX_Y,floor(m.y + m.r)); y++) {
+			double half = sqrt(m.r*m.r - (y - m.y)*(y - m.y));
+			int x1 = std::max(0.0,ceil(m.x - half)), x2 = std::min((double)OPTITRACK_MAX_X,floor(m.x + half)) + 1;
+			if (x2 > x1) lines.push_back({ (short)y, (short)x1, (short)x2 });
+		}
+
+		m.x += m.vx; m.y += m.vy;
+		if (m.x < 0 || m.x > OPTITRACK_MAX_X) m.vx = -m.vx;
+		if (m.y < 0 || m.y > OPTITRACK_MAX_Y) m.vy = -m.vy;
+	}
+
+	std::sort(lines.begin(),lines.end(),[](const optitrack_scanline& a, const optitrack_scanline& b) {
+		return (a.y != b.y) ? (a.y < b.y) : (a.x1 < b.x1);
+	});
+
+	size_t count = 0;
+	for (const optitrack_scanline& line: lines) {
+		if (count > 0 && lines[count-1].y == line.y && lines[count-1].x2 >= line.x1)
+			lines[count-1].x2 = std::max(lines[count-1].x2,line.x2);
+		else lines[count++] = line;
+	}
+
+	// too many markers for one transfer: leave out the bottom rows
+	int length;
+	while (!(length = optitrack_encode(lines.data(),count,frame,CAPTURE_FRAME_SIZE))) count -= 16;
+
+	return length;
+}
+
+static void synthetic_run(struct capture* cap) {
+
+	unsigned char frame[CAPTURE_FRAME_SIZE];
+	uint64_t next = now();
+
+	for (int n = 0; cap->running && (cap->frames == 0 || n < cap->frames); n++) {
+
+		int length = render(cap,frame);
+
+		if (cap->fps > 0) {
+			wait_until(next);
+			next += 1000000000ULL / cap->fps;
+		}
+
+		deliver(cap,frame,length,now());
+	}
+
+	finish(cap);
+}
+
+static void synthetic_release(struct capture* cap) { }
+
+struct capture* capture_open_synthetic(int markers, int frames, int fps, unsigned int seed) {
+
+	struct capture* cap = capture_alloc();
+
+	cap->run = synthetic_run;
+	cap->release = synthetic_release;
+	cap->frames = frames;
+	cap->fps = fps;
+	cap->seed = seed;
+
+	// radius 2 .. 8 pixels, up to 3 pixels per frame in each direction
+	for (int i = 0; i < markers; i++) {
+		capture::marker m;
+		m.r  = 2 + 6 * uniform(cap);
+		m.x  = uniform(cap) * OPTITRACK_MAX_X;
+		m.y  = uniform(cap) * OPTITRACK_MAX_Y;
+		m.vx = 6 * uniform(cap) - 3;
+		m.vy = 6 * uniform(cap) - 3;
+		cap->markers.push_back(m);
+	}
+
+	return cap;
+}
+
+
+// common part
+
+int capture_start(struct capture* cap, capture_callback callback, void* user) {
+
+	if (cap->running) return -1;
+
+	cap->callback = callback;
+	cap->user = user;
+	cap->running = true;
+
+	cap->thread = std::thread(cap->run,cap);
+	return 0;
+}
+
+int capture_next(struct capture* cap, struct capture_frame* frame, int timeout) {
+
+	std::unique_lock<std::mutex> guard(cap->lock);
+
+	if (!cap->cond.wait_for(guard,std::chrono::milliseconds(timeout),
+		[cap]{ return (cap->head != cap->tail) || cap->finished; }))
+		return 0;
+
+	if (cap->head == cap->tail) return -1;
+
+	*frame = cap->queue[cap->tail % CAPTURE_QUEUE_SIZE];
+	frame->header.dropped += cap->missed;
+	cap->missed = 0;
+	cap->tail++;
+
+	return 1;
+}
+
+void capture_close(struct capture* cap) {
+
+	cap->running = false;
+	if (cap->thread.joinable()) cap->thread.join();
+
+	cap->release(cap);
+	delete[] cap->queue;
+	delete cap;
+}
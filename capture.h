@@ -0,0 +1,58 @@
+/* NaturalPoint Optitrack userspace capture
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include "optitrack.h"
+
+// largest frame the camera sends in one bulk transfer
+#define CAPTURE_FRAME_SIZE 4096
+
+// frames buffered between the event thread and capture_next()
+#define CAPTURE_QUEUE_SIZE 64
+
+// frames carry the same header the kernel driver uses
+struct capture_frame {
+	struct optitrack_frame header;
+	unsigned char data[CAPTURE_FRAME_SIZE];
+};
+
+// called on the event thread for every frame, must not block
+typedef void (*capture_callback)(const struct optitrack_frame* header, const unsigned char* data, void* user);
+
+struct capture;
+
+// first camera on the bus through libusb-1.0, with transfers bulk reads queued
+struct capture* capture_open_usb(int transfers);
+
+// stand-in for a camera: raw dump of bulk transfers, replayed at fps (0 = as fast as possible)
+struct capture* capture_open_stream(const char* path, int fps);
+
+// recording made with record.h, replayed with the original gaps between
+// frames divided by speed (1 = real time, 0 = as fast as possible)
+struct capture* capture_open_replay(const char* path, double speed);
+
+// no input at all: markers moving discs rendered and encoded like camera
+// frames, filler records included, frames long (0 = endless) at fps
+// (0 = as fast as possible), the same seed always gives the same frames
+struct capture* capture_open_synthetic(int markers, int frames, int fps, unsigned int seed);
+
+// start the event thread, frames go to callback if given, to the queue otherwise
+int capture_start(struct capture* cap, capture_callback callback, void* user);
+
+// wait up to timeout ms for a queued frame: 1 = got one, 0 = timeout, -1 = end of stream
+int capture_next(struct capture* cap, struct capture_frame* frame, int timeout);
+
+// stop the event thread and release everything
+void capture_close(struct capture* cap);
+
+#endif
@@ -0,0 +1,121 @@
+/* NaturalPoint Optitrack sub-pixel blob centroids
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <math.h> // sqrt()
+
+#include "centroid.h"
+
+// outer edges of one row of a blob, rows with several runs are treated as one
+struct row { double y, left, right; };
+
+// walk the rows of blob b from top to bottom, calling f(row) for each
+template <typename F> static void rows(const optitrack_decoded* lines, const optitrack_labels* labels, int b, F f) {
+
+	row r = { -1, 0, 0 };
+
+	for (int k = labels->start[b]; k < labels->start[b+1]; k++) {
+		int i = labels->order[k];
+		if (r.y != lines->y[i]) {
+			if (r.y >= 0) f(r);
+			r.y = lines->y[i];
+			r.left = lines->x1[i] - 0.5;
+			r.right = lines->x2[i] - 0.5;
+		} else {
+			if (lines->x1[i] - 0.5 < r.left) r.left = lines->x1[i] - 0.5;
+			if (lines->x2[i] - 0.5 > r.right) r.right = lines->x2[i] - 0.5;
+		}
+	}
+
+	if (r.y >= 0) f(r);
+}
+
+// what optitrack_label() already summed up
+static void moments(const optitrack_labels* labels, int b, optitrack_centroid* out) {
+	const optitrack_blob& blob = labels->blobs[b];
+	out->x = blob.cx / 256.0f;
+	out->y = blob.cy / 256.0f;
+	out->radius = sqrt(blob.area / M_PI);
+}
+
+/*
+  Algebraic (Kasa) fit of x^2 + y^2 + D*x + E*y + F = 0 through the left and
+  right edge of every row and the middle of the top and bottom edge,
+  relative to the blob centroid to keep the sums well conditioned. Unlike
+  the other methods this still finds the center of a marker cut off by
+  the sensor border.
+*/
+static void circle(const optitrack_decoded* lines, const optitrack_labels* labels, int b, optitrack_centroid* out) {
+
+	const optitrack_blob& blob = labels->blobs[b];
+	double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0, sxz = 0, syz = 0, sz = 0, n = 0;
+	double ox, oy;
+	row first = { -1, 0, 0 }, last = { -1, 0, 0 };
+
+	moments(labels,b,out);
+	if (blob.y2 - blob.y1 < 3) return;
+	ox = out->x; oy = out->y;
+
+	auto add = [&](double x, double y) {
+		x -= ox; y -= oy;
+		double z = x*x + y*y;
+		sx += x; sy += y; sxx += x*x; syy += y*y; sxy += x*y;
+		sxz += x*z; syz += y*z; sz += z; n++;
+	};
+
+	// edges on the sensor border are where the image ends, not the marker
+	rows(lines,labels,b,[&](const row& r) {
+		if (first.y < 0) first = r;
+		last = r;
+		if (r.left > -0.5) add(r.left,r.y);
+		if (r.right < OPTITRACK_MAX_X - 0.5) add(r.right,r.y);
+	});
+
+	if (first.y > 0) add((first.left + first.right) / 2,first.y - 0.5);
+	if (last.y < OPTITRACK_MAX_Y) add((last.left + last.right) / 2,last.y + 0.5);
+	if (n < 3) return;
+
+	// solve the normal equations by Cramer's rule
+	double a[3][3] = { { sxx, sxy, sx }, { sxy, syy, sy }, { sx, sy, n } };
+	double r[3] = { -sxz, -syz, -sz };
+
+	auto det = [](double m[3][3]) {
+		return m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1])
+		     - m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0])
+		     + m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+	};
+
+	double d = det(a);
+	if (fabs(d) < 1e-9) return;
+
+	double s[3];
+	for (int c = 0; c < 3; c++) {
+		double m[3][3];
+		for (int i = 0; i < 3; i++) for (int j = 0; j < 3; j++) m[i][j] = (j == c) ? r[i] : a[i][j];
+		s[c] = det(m) / d;
+	}
+
+	double cx = -s[0] / 2, cy = -s[1] / 2, rr = cx*cx + cy*cy - s[2];
+	if (rr <= 0) return;
+
+	out->x = ox + cx;
+	out->y = oy + cy;
+	out->radius = sqrt(rr);
+}
+
+void optitrack_centroids(const optitrack_decoded* lines, const optitrack_labels* labels, int method, optitrack_centroid* out) {
+
+	for (int b = 0; b < labels->count; b++) {
+		switch (method) {
+			case OPTITRACK_CENTROID_CIRCLE: circle(lines,labels,b,&out[b]); break;
+			default: moments(labels,b,&out[b]);
+		}
+	}
+}
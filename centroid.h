@@ -0,0 +1,42 @@
+/* NaturalPoint Optitrack sub-pixel blob centroids
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _CENTROID_H
+#define _CENTROID_H
+
+#include "decode.h"
+#include "label.h"
+
+/*
+  Pixel x covers x-0.5 .. x+0.5, so a run x1 .. x2 has its edges at x1-0.5
+  and x2-0.5. Methods, in order of CPU cost:
+
+  MOMENTS: area-weighted run centers, what optitrack_label() reports
+  CIRCLE:  least-squares circle through the run edges at the row centers,
+           ignoring those on the sensor border, falls back to MOMENTS for
+           blobs with less than three rows
+
+  MOMENTS is the better one for whole markers, CIRCLE still finds the
+  center of markers cut off by the sensor border (see bench_centroid).
+*/
+#define OPTITRACK_CENTROID_MOMENTS 0
+#define OPTITRACK_CENTROID_CIRCLE  1
+
+struct optitrack_centroid {
+	float x, y;   // sensor pixels
+	float radius; // fitted radius for CIRCLE, otherwise that of a disc with the same area
+};
+
+// centroids of all labeled blobs, out needs room for labels->count entries
+void optitrack_centroids(const struct optitrack_decoded* lines, const struct optitrack_labels* labels,
+	int method, struct optitrack_centroid* out);
+
+#endif
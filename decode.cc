@@ -0,0 +1,238 @@
+/* NaturalPoint Optitrack vectorized frame decoder
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <string.h> // strcmp()
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DECODE_X86
+#include <immintrin.h>
+#endif
+
+#include "decode.h"
+
+// number of whole records in the frame, capped so the output arrays can't overflow
+static int records(int length) {
+	int count = (length - OPTITRACK_RECORD_START) / OPTITRACK_RECORD_SIZE;
+	if (count < 0) count = 0;
+	if (count > OPTITRACK_MAX_LINES) count = OPTITRACK_MAX_LINES;
+	return count;
+}
+
+static void reset(optitrack_decoded* out) {
+	out->count = 0;
+	out->marker_count = 0;
+	out->out_of_range = 0;
+}
+
+// one record the slow way, returns 0 at the end of the frame
+static inline int decode_one(const unsigned char* record, optitrack_decoded* out) {
+
+	int y, x1, x2;
+
+	switch (optitrack_decode_record(record,&y,&x1,&x2)) {
+		case OPTITRACK_RECORD_END:   return 0;
+		case OPTITRACK_RECORD_SKIP:  out->markers[out->marker_count++] = out->count; break;
+		case OPTITRACK_RECORD_RANGE: out->out_of_range++; break;
+		default:
+			out->y [out->count] = y;
+			out->x1[out->count] = x1;
+			out->x2[out->count] = x2;
+			out->count++;
+	}
+
+	return 1;
+}
+
+static void decode_scalar(const unsigned char* frame, int length, optitrack_decoded* out) {
+
+	const unsigned char* data = frame + OPTITRACK_RECORD_START;
+	int count = records(length);
+
+	reset(out);
+
+	for (int i = 0; i < count; i++)
+		if (!decode_one(data + i*OPTITRACK_RECORD_SIZE,out)) return;
+}
+
+
+#ifdef DECODE_X86
+
+/*
+  Records are loaded as little-endian 32 bit lanes y | x1 << 8 | x2 << 16 | in << 24.
+  A group of lanes where every record is a valid line - the common case -
+  is decoded and stored without a branch per record. Groups containing a
+  filler, the end record or something out of range go through decode_one()
+  so markers and counts come out exactly like the scalar version.
+*/
+
+__attribute__((target("sse2")))
+static void decode_sse2(const unsigned char* frame, int length, optitrack_decoded* out) {
+
+	const unsigned char* data = frame + OPTITRACK_RECORD_START;
+	int count = records(length);
+	int i = 0;
+
+	const __m128i byte   = _mm_set1_epi32(0xFF);
+	const __m128i one    = _mm_set1_epi32(1);
+	const __m128i zero   = _mm_setzero_si128();
+	const __m128i filler = _mm_set1_epi32(OPTITRACK_RECORD_FILLER << 24);
+	const __m128i offy   = _mm_set1_epi32(OPTITRACK_OFFSET_Y);
+	const __m128i offx   = _mm_set1_epi32(OPTITRACK_OFFSET_X);
+	const __m128i maxy   = _mm_set1_epi32(OPTITRACK_MAX_Y);
+	const __m128i maxx   = _mm_set1_epi32(OPTITRACK_MAX_X);
+
+	reset(out);
+
+	for (; i + 4 <= count; i += 4) {
+
+		const unsigned char* group = data + i*OPTITRACK_RECORD_SIZE;
+		__m128i v = _mm_loadu_si128((const __m128i*)group);
+
+		// msb * 255 == (msb << 8) - msb
+		__m128i my  = _mm_and_si128(_mm_srli_epi32(v,29),one);
+		__m128i mx2 = _mm_and_si128(_mm_srli_epi32(v,30),one);
+		__m128i mx1 = _mm_srli_epi32(v,31);
+
+		__m128i y  = _mm_and_si128(v,byte);
+		__m128i x1 = _mm_and_si128(_mm_srli_epi32(v,8),byte);
+		__m128i x2 = _mm_and_si128(_mm_srli_epi32(v,16),byte);
+
+		y  = _mm_sub_epi32(_mm_add_epi32(y, _mm_sub_epi32(_mm_slli_epi32(my, 8),my )),offy);
+		x1 = _mm_sub_epi32(_mm_add_epi32(x1,_mm_sub_epi32(_mm_slli_epi32(mx1,8),mx1)),offx);
+		x2 = _mm_sub_epi32(_mm_add_epi32(x2,_mm_sub_epi32(_mm_slli_epi32(mx2,8),mx2)),offx);
+
+		// end record or outside the sensor, fillers don't count as out of range
+		__m128i fill = _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(v,filler),zero),_mm_cmpeq_epi32(zero,zero));
+		__m128i bad  = _mm_or_si128(_mm_cmpgt_epi32(zero,y),_mm_cmpgt_epi32(y,maxy));
+		bad = _mm_or_si128(bad,_mm_or_si128(_mm_cmpgt_epi32(zero,x1),_mm_cmpgt_epi32(x1,maxx)));
+		bad = _mm_or_si128(bad,_mm_or_si128(_mm_cmpgt_epi32(zero,x2),_mm_cmpgt_epi32(x2,maxx)));
+		bad = _mm_or_si128(_mm_andnot_si128(fill,bad),_mm_cmpeq_epi32(v,zero));
+
+		int fills = _mm_movemask_ps(_mm_castsi128_ps(fill));
+		int lanes = 4;
+
+		if (_mm_movemask_ps(_mm_castsi128_ps(bad)) || (fills & ~0x8)) {
+			for (int j = 0; j < 4; j++)
+				if (!decode_one(group + j*OPTITRACK_RECORD_SIZE,out)) return;
+			continue;
+		}
+
+		// a filler in the last lane (where packet boundaries fall) is simply not counted
+		if (fills) {
+			lanes--;
+			out->markers[out->marker_count++] = out->count + lanes;
+		}
+
+		_mm_storel_epi64((__m128i*)(out->y +out->count),_mm_packs_epi32(y, y ));
+		_mm_storel_epi64((__m128i*)(out->x1+out->count),_mm_packs_epi32(x1,x1));
+		_mm_storel_epi64((__m128i*)(out->x2+out->count),_mm_packs_epi32(x2,x2));
+		out->count += lanes;
+	}
+
+	for (; i < count; i++)
+		if (!decode_one(data + i*OPTITRACK_RECORD_SIZE,out)) return;
+}
+
+// same as decode_sse2(), 8 records per iteration
+__attribute__((target("avx2")))
+static void decode_avx2(const unsigned char* frame, int length, optitrack_decoded* out) {
+
+	const unsigned char* data = frame + OPTITRACK_RECORD_START;
+	int count = records(length);
+	int i = 0;
+
+	const __m256i byte   = _mm256_set1_epi32(0xFF);
+	const __m256i one    = _mm256_set1_epi32(1);
+	const __m256i zero   = _mm256_setzero_si256();
+	const __m256i filler = _mm256_set1_epi32(OPTITRACK_RECORD_FILLER << 24);
+	const __m256i offy   = _mm256_set1_epi32(OPTITRACK_OFFSET_Y);
+	const __m256i offx   = _mm256_set1_epi32(OPTITRACK_OFFSET_X);
+	const __m256i maxy   = _mm256_set1_epi32(OPTITRACK_MAX_Y);
+	const __m256i maxx   = _mm256_set1_epi32(OPTITRACK_MAX_X);
+
+	reset(out);
+
+	for (; i + 8 <= count; i += 8) {
+
+		const unsigned char* group = data + i*OPTITRACK_RECORD_SIZE;
+		__m256i v = _mm256_loadu_si256((const __m256i*)group);
+
+		__m256i my  = _mm256_and_si256(_mm256_srli_epi32(v,29),one);
+		__m256i mx2 = _mm256_and_si256(_mm256_srli_epi32(v,30),one);
+		__m256i mx1 = _mm256_srli_epi32(v,31);
+
+		__m256i y  = _mm256_and_si256(v,byte);
+		__m256i x1 = _mm256_and_si256(_mm256_srli_epi32(v,8),byte);
+		__m256i x2 = _mm256_and_si256(_mm256_srli_epi32(v,16),byte);
+
+		y  = _mm256_sub_epi32(_mm256_add_epi32(y, _mm256_sub_epi32(_mm256_slli_epi32(my, 8),my )),offy);
+		x1 = _mm256_sub_epi32(_mm256_add_epi32(x1,_mm256_sub_epi32(_mm256_slli_epi32(mx1,8),mx1)),offx);
+		x2 = _mm256_sub_epi32(_mm256_add_epi32(x2,_mm256_sub_epi32(_mm256_slli_epi32(mx2,8),mx2)),offx);
+
+		__m256i fill = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(v,filler),zero),_mm256_cmpeq_epi32(zero,zero));
+		__m256i bad  = _mm256_or_si256(_mm256_cmpgt_epi32(zero,y),_mm256_cmpgt_epi32(y,maxy));
+		bad = _mm256_or_si256(bad,_mm256_or_si256(_mm256_cmpgt_epi32(zero,x1),_mm256_cmpgt_epi32(x1,maxx)));
+		bad = _mm256_or_si256(bad,_mm256_or_si256(_mm256_cmpgt_epi32(zero,x2),_mm256_cmpgt_epi32(x2,maxx)));
+		bad = _mm256_or_si256(_mm256_andnot_si256(fill,bad),_mm256_cmpeq_epi32(v,zero));
+
+		int fills = _mm256_movemask_ps(_mm256_castsi256_ps(fill));
+		int lanes = 8;
+
+		if (_mm256_movemask_ps(_mm256_castsi256_ps(bad)) || (fills & ~0x80)) {
+			for (int j = 0; j < 8; j++)
+				if (!decode_one(group + j*OPTITRACK_RECORD_SIZE,out)) return;
+			continue;
+		}
+
+		// a filler in the last lane (where packet boundaries fall) is simply not counted
+		if (fills) {
+			lanes--;
+			out->markers[out->marker_count++] = out->count + lanes;
+		}
+
+		// packs works per 128 bit half, the permute moves both results together
+		_mm_storeu_si128((__m128i*)(out->y +out->count),_mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packs_epi32(y, y ),0x08)));
+		_mm_storeu_si128((__m128i*)(out->x1+out->count),_mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packs_epi32(x1,x1),0x08)));
+		_mm_storeu_si128((__m128i*)(out->x2+out->count),_mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packs_epi32(x2,x2),0x08)));
+		out->count += lanes;
+	}
+
+	for (; i < count; i++)
+		if (!decode_one(data + i*OPTITRACK_RECORD_SIZE,out)) return;
+}
+
+#endif
+
+
+optitrack_decoder optitrack_decoder_get(const char* name) {
+
+	if (!strcmp(name,"scalar")) return decode_scalar;
+
+#ifdef DECODE_X86
+	__builtin_cpu_init();
+	if (!strcmp(name,"sse2") && __builtin_cpu_supports("sse2")) return decode_sse2;
+	if (!strcmp(name,"avx2") && __builtin_cpu_supports("avx2")) return decode_avx2;
+#endif
+
+	return 0;
+}
+
+const char* optitrack_decoder_name() {
+	static const char* name =
+		optitrack_decoder_get("avx2") ? "avx2" :
+		optitrack_decoder_get("sse2") ? "sse2" : "scalar";
+	return name;
+}
+
+void optitrack_decode(const unsigned char* frame, int length, optitrack_decoded* out) {
+	static optitrack_decoder decoder = optitrack_decoder_get(optitrack_decoder_name());
+	decoder(frame,length,out);
+}
@@ -0,0 +1,45 @@
+/* NaturalPoint Optitrack vectorized frame decoder
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _DECODE_H
+#define _DECODE_H
+
+#include "protocol.h"
+
+// decoded frame, one array per coordinate so the decoder can store whole vectors
+struct optitrack_decoded {
+
+	short y [OPTITRACK_MAX_LINES];
+	short x1[OPTITRACK_MAX_LINES];
+	short x2[OPTITRACK_MAX_LINES];
+	int count;
+
+	// filler records (USB packet boundaries, the old "next blob" marker),
+	// each one stored as the number of lines decoded before it
+	int markers[OPTITRACK_MAX_LINES];
+	int marker_count;
+
+	int out_of_range; // records outside the sensor area
+};
+
+// decodes at most OPTITRACK_MAX_LINES records, same results as optitrack_parse()
+typedef void (*optitrack_decoder)(const unsigned char* frame, int length, struct optitrack_decoded* out);
+
+// decoder by name ("scalar", "sse2", "avx2"), 0 if this CPU can't run it
+optitrack_decoder optitrack_decoder_get(const char* name);
+
+// name of the decoder used by optitrack_decode()
+const char* optitrack_decoder_name();
+
+// decode with the fastest decoder this CPU supports
+void optitrack_decode(const unsigned char* frame, int length, struct optitrack_decoded* out);
+
+#endif
@@ -0,0 +1,119 @@
+/* NaturalPoint Optitrack blob labeling on decoded scanlines
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdint.h> // uint64_t
+
+#include "label.h"
+
+static inline int find_root(int* parent, int i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+static inline void join(int* parent, int a, int b) {
+	a = find_root(parent,a);
+	b = find_root(parent,b);
+	// keep the older line as root, so blobs are numbered in order of appearance
+	if (a < b) parent[b] = a; else if (b < a) parent[a] = b;
+}
+
+int optitrack_label(const optitrack_decoded* lines, optitrack_labels* out) {
+
+	const short *y = lines->y, *x1 = lines->x1, *x2 = lines->x2;
+	int* parent = out->parent;
+
+	// previous row is prev .. curr-1, current row starts at curr
+	int prev = 0, curr = 0, next = 0;
+	bool prev_sorted = true, curr_sorted = true;
+
+	for (int i = 0; i < lines->count; i++) {
+
+		parent[i] = i;
+
+		if ((i == 0) || (y[i] != y[i-1])) {
+			bool adjacent = (i > 0) && (y[i] == y[i-1] + 1);
+			prev = adjacent ? curr : i;
+			prev_sorted = curr_sorted;
+			next = prev;
+			curr = i;
+			curr_sorted = true;
+		} else if (x1[i] < x1[i-1])
+			curr_sorted = false;
+
+		if (x2[i] <= x1[i]) continue;
+
+		if (prev_sorted && curr_sorted) {
+			// lines in the row above ending left of this one can't touch the following ones either
+			while ((next < curr) && (x2[next] < x1[i])) next++;
+			for (int j = next; (j < curr) && (x1[j] <= x2[i]); j++)
+				if (x2[j] > x1[j]) join(parent,j,i);
+		} else {
+			for (int j = prev; j < curr; j++)
+				if ((x2[j] > x1[j]) && (x1[j] <= x2[i]) && (x2[j] >= x1[i])) join(parent,j,i);
+		}
+	}
+
+	// number the roots and accumulate area, coordinate sums and bounding box
+	optitrack_blob* blobs = out->blobs;
+	uint64_t sx[OPTITRACK_MAX_BLOBS], sy[OPTITRACK_MAX_BLOBS];
+	int count = 0;
+
+	for (int i = 0; i < lines->count; i++) {
+
+		out->blob[i] = -1;
+		if (x2[i] <= x1[i]) continue;
+
+		int root = find_root(parent,i);
+		int b = (root == i) ? -1 : out->blob[root];
+
+		if (root == i) {
+			if (count == OPTITRACK_MAX_BLOBS) continue;
+			b = count++;
+			blobs[b].area = 0; sx[b] = sy[b] = 0;
+			blobs[b].x1 = OPTITRACK_MAX_X; blobs[b].y1 = OPTITRACK_MAX_Y;
+			blobs[b].x2 = 0; blobs[b].y2 = 0;
+		}
+		if (b < 0) continue;
+
+		out->blob[i] = b;
+
+		int area = x2[i] - x1[i];
+		blobs[b].area += area;
+		sx[b] += area * (x1[i] + x2[i] - 1); // twice the x sum
+		sy[b] += area * y[i];
+
+		if (x1[i] < blobs[b].x1) blobs[b].x1 = x1[i];
+		if (x2[i] > blobs[b].x2) blobs[b].x2 = x2[i];
+		if (y[i] < blobs[b].y1) blobs[b].y1 = y[i];
+		if (y[i] >= blobs[b].y2) blobs[b].y2 = y[i] + 1;
+	}
+
+	// centroids in 1/256 pixel, like the driver
+	for (int b = 0; b < count; b++) {
+		blobs[b].cx = sx[b] * 128 / blobs[b].area;
+		blobs[b].cy = sy[b] * 256 / blobs[b].area;
+	}
+
+	// group the lines by blob with a counting sort
+	for (int b = 0; b <= count; b++) out->start[b] = 0;
+	for (int i = 0; i < lines->count; i++) if (out->blob[i] >= 0) out->start[out->blob[i]+1]++;
+	for (int b = 0; b < count; b++) out->start[b+1] += out->start[b];
+
+	int fill[OPTITRACK_MAX_BLOBS];
+	for (int b = 0; b < count; b++) fill[b] = out->start[b];
+	for (int i = 0; i < lines->count; i++) if (out->blob[i] >= 0) out->order[fill[out->blob[i]]++] = i;
+
+	out->count = count;
+	return count;
+}
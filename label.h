@@ -0,0 +1,44 @@
+/* NaturalPoint Optitrack blob labeling on decoded scanlines
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _LABEL_H
+#define _LABEL_H
+
+#include "optitrack.h"
+#include "decode.h"
+
+// blobs of one frame, all storage is fixed so labeling never allocates
+struct optitrack_labels {
+
+	// same results as the driver's blob mode
+	struct optitrack_blob blobs[OPTITRACK_MAX_BLOBS];
+	int count;
+
+	// blob of every decoded line, -1 for empty lines and blobs beyond OPTITRACK_MAX_BLOBS
+	int blob[OPTITRACK_MAX_LINES];
+
+	// lines grouped by blob: blob b owns order[start[b]] .. order[start[b+1]-1], in row order
+	int order[OPTITRACK_MAX_LINES];
+	int start[OPTITRACK_MAX_BLOBS+1];
+
+	// union-find forest over the lines
+	int parent[OPTITRACK_MAX_LINES];
+};
+
+/*
+  Group lines that touch (including diagonally) in adjacent rows into
+  blobs. Lines have to arrive row by row with ascending y, as the camera
+  sends them; inside a row, left-to-right order keeps this O(lines).
+  Returns the number of blobs.
+*/
+int optitrack_label(const struct optitrack_decoded* lines, struct optitrack_labels* out);
+
+#endif
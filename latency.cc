@@ -0,0 +1,220 @@
+/* NaturalPoint Optitrack latency histograms
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // calloc() etc.
+#include <string.h> // strncpy() etc.
+#include <unistd.h> // ftruncate() etc.
+#include <fcntl.h>  // O_CREAT etc.
+#include <signal.h> // kill()
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <new>
+
+#include "latency.h"
+
+const char* latency_names[LATENCY_STAGES] = { "read", "decode", "label", "upload", "swap", "total" };
+
+static latency_segment* segment = 0;
+static char shm_name[64] = "";
+
+// true if name is left over from a process that is gone
+static bool stale(const char* name) {
+
+	const latency_segment* seg = latency_attach(name);
+	if (!seg) return false; // not initialized yet, or some other program's
+
+	pid_t pid = seg->pid;
+	munmap((void*)seg,sizeof(latency_segment));
+	return kill(pid,0) < 0 && errno == ESRCH;
+}
+
+// a new segment under name, never one somebody else is using
+static int create(const char* name) {
+
+	int fd = shm_open(name,O_CREAT | O_EXCL | O_RDWR,0644);
+	if (fd < 0 && errno == EEXIST && stale(name)) {
+		shm_unlink(name);
+		fd = shm_open(name,O_CREAT | O_EXCL | O_RDWR,0644);
+	}
+	return fd;
+}
+
+int latency_open(const char* name) {
+
+	void* mem = 0;
+
+	if (name) {
+		// another viewer has the name: fall back to one with our pid
+		snprintf(shm_name,sizeof(shm_name),"%s",name);
+		int fd = create(shm_name);
+		if (fd < 0 && errno == EEXIST) {
+			snprintf(shm_name,sizeof(shm_name),"%s.%d",name,(int)getpid());
+			fd = create(shm_name);
+		}
+		if (fd < 0) { perror(shm_name); shm_name[0] = 0; return -1; }
+		if (ftruncate(fd,sizeof(latency_segment)) == 0)
+			mem = mmap(0,sizeof(latency_segment),PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+		close(fd);
+		if (!mem || mem == MAP_FAILED) { perror(shm_name); shm_unlink(shm_name); shm_name[0] = 0; return -1; }
+	} else {
+		mem = calloc(1,sizeof(latency_segment));
+		if (!mem) return -1;
+	}
+
+	latency_segment* seg = new (mem) latency_segment();
+	seg->version = LATENCY_VERSION;
+	seg->stages  = LATENCY_STAGES;
+	seg->buckets = LATENCY_BUCKETS;
+	seg->threads = LATENCY_THREADS;
+	seg->pid     = getpid();
+
+	// readers check the magic last
+	std::atomic_thread_fence(std::memory_order_release);
+	seg->magic = LATENCY_MAGIC;
+
+	segment = seg;
+	return 0;
+}
+
+latency_thread* latency_register(const char* name) {
+
+	if (!segment) return 0;
+
+	uint32_t n = segment->registered.fetch_add(1);
+	if (n >= LATENCY_THREADS) return 0;
+
+	latency_thread* t = &segment->thread[n];
+	strncpy(t->name,name,sizeof(t->name) - 1);
+	t->used.store(1,std::memory_order_release);
+	return t;
+}
+
+void latency_close() {
+
+	if (!segment) return;
+
+	if (shm_name[0]) {
+		munmap(segment,sizeof(latency_segment));
+		shm_unlink(shm_name);
+		shm_name[0] = 0;
+	} else free(segment);
+
+	segment = 0;
+}
+
+const latency_segment* latency_attach(const char* name) {
+
+	int fd = shm_open(name,O_RDONLY,0);
+	if (fd < 0) return 0;
+
+	struct stat st;
+	void* mem = MAP_FAILED;
+	if (!fstat(fd,&st) && st.st_size >= (off_t)sizeof(latency_segment))
+		mem = mmap(0,sizeof(latency_segment),PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if (mem == MAP_FAILED) return 0;
+
+	const latency_segment* seg = (const latency_segment*)mem;
+	if (seg->magic != LATENCY_MAGIC || seg->version != LATENCY_VERSION ||
+	    seg->stages != LATENCY_STAGES || seg->buckets != LATENCY_BUCKETS || seg->threads != LATENCY_THREADS) {
+		munmap(mem,sizeof(latency_segment));
+		return 0;
+	}
+
+	return seg;
+}
+
+const latency_segment* latency_local() {
+	return segment;
+}
+
+const char* latency_name() {
+	return shm_name[0] ? shm_name : 0;
+}
+
+void latency_collect(const latency_segment* seg, latency_summary out[LATENCY_STAGES]) {
+
+	memset(out,0,LATENCY_STAGES * sizeof(latency_summary));
+
+	for (int n = 0; n < LATENCY_THREADS; n++) {
+
+		const latency_thread& t = seg->thread[n];
+		if (!t.used.load(std::memory_order_acquire)) continue;
+
+		for (int s = 0; s < LATENCY_STAGES; s++) {
+			const latency_histogram& h = t.stage[s];
+			out[s].count += h.count.load(std::memory_order_relaxed);
+			out[s].sum   += h.sum.load(std::memory_order_relaxed);
+			uint64_t max  = h.max.load(std::memory_order_relaxed);
+			if (max > out[s].max) out[s].max = max;
+			for (int b = 0; b < LATENCY_BUCKETS; b++)
+				out[s].bucket[b] += h.bucket[b].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+// smallest value that falls into bucket b
+static uint64_t lowest(int b) {
+	if (b < (1 << LATENCY_SUB_BITS)) return b;
+	int e = (b >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+	return (uint64_t)((1 << LATENCY_SUB_BITS) + (b & ((1 << LATENCY_SUB_BITS) - 1))) << (e - LATENCY_SUB_BITS);
+}
+
+uint64_t latency_percentile(const latency_summary* s, double p) {
+
+	uint64_t total = 0;
+	for (int b = 0; b < LATENCY_BUCKETS; b++) total += s->bucket[b];
+	if (!total) return 0;
+
+	// rank of the value asked for, then the middle of its bucket
+	uint64_t rank = (uint64_t)(p * total + 0.5), seen = 0;
+	if (rank < 1) rank = 1;
+
+	for (int b = 0; b < LATENCY_BUCKETS; b++) {
+		seen += s->bucket[b];
+		if (seen < rank) continue;
+		uint64_t low = lowest(b), high = (b + 1 < LATENCY_BUCKETS) ? lowest(b + 1) : low * 2;
+		uint64_t mid = low + (high - low) / 2;
+		return (s->max && mid > s->max) ? s->max : mid;
+	}
+
+	return s->max;
+}
+
+void latency_print(FILE* out, const latency_summary now[LATENCY_STAGES], const latency_summary before[LATENCY_STAGES]) {
+
+	latency_summary d;
+
+	fprintf(out,"stage      count     mean us    p50 us    p99 us  p99.9 us    max us\n");
+
+	for (int s = 0; s < LATENCY_STAGES; s++) {
+
+		d = now[s];
+		if (before) {
+			d.count -= before[s].count;
+			d.sum   -= before[s].sum;
+			for (int b = 0; b < LATENCY_BUCKETS; b++) d.bucket[b] -= before[s].bucket[b];
+			// the maximum can't be taken apart, use the highest bucket hit instead
+			d.max = 0;
+			for (int b = LATENCY_BUCKETS - 1; b >= 0; b--)
+				if (d.bucket[b]) { d.max = (b + 1 < LATENCY_BUCKETS) ? lowest(b + 1) - 1 : now[s].max; break; }
+			if (d.max > now[s].max) d.max = now[s].max;
+		}
+
+		if (!d.count) { fprintf(out,"%-8s %7d\n",latency_names[s],0); continue; }
+
+		fprintf(out,"%-8s %7lu %11.1f %9.1f %9.1f %9.1f %9.1f\n",latency_names[s],(unsigned long)d.count,
+			d.sum / 1e3 / d.count,latency_percentile(&d,0.5) / 1e3,latency_percentile(&d,0.99) / 1e3,
+			latency_percentile(&d,0.999) / 1e3,d.max / 1e3);
+	}
+}
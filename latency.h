@@ -0,0 +1,147 @@
+/* NaturalPoint Optitrack latency histograms
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdio.h>  // FILE
+#include <stdint.h>
+#include <time.h>   // clock_gettime()
+
+#include <atomic>
+
+/*
+  Always-on latency histograms for the stages a frame goes through on
+  its way from the USB completion to the screen. Every thread gets its
+  own set of histograms and is the only one writing them, so recording
+  a value is a handful of plain loads and stores, no locks and no
+  atomic read-modify-write. Readers add up the threads; a value recorded
+  while they read may show up in one field and not yet in another.
+
+  The histograms are log-linear like HdrHistogram: values below
+  2^LATENCY_SUB_BITS ns have a bucket each, above that every power of two
+  is split into 2^LATENCY_SUB_BITS buckets, so any value is known to
+  about 3%. Values of 2^LATENCY_MAX_BITS ns (68 s) and more go into the
+  last bucket.
+
+  The segment can live in POSIX shared memory, where latstat and other
+  programs can watch it while the viewer runs.
+*/
+
+#define LATENCY_SUB_BITS 5
+#define LATENCY_MAX_BITS 36
+#define LATENCY_BUCKETS  ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+#define LATENCY_THREADS 8
+
+#define LATENCY_MAGIC   0x5954414C // "LATY"
+#define LATENCY_VERSION 1
+
+// default shared memory name of the viewer
+#define LATENCY_SHM "/optitrack-latency"
+
+// what each stage measures, see main.cc
+enum {
+	LATENCY_READ,    // URB completion until read() returned it
+	LATENCY_DECODE,  // decoding the runs
+	LATENCY_LABEL,   // connecting the runs into blobs
+	LATENCY_UPLOAD,  // handed to the renderer until texture / vertex upload
+	LATENCY_SWAP,    // glutSwapBuffers()
+	LATENCY_TOTAL,   // URB completion until the buffers were swapped
+	LATENCY_STAGES
+};
+
+extern const char* latency_names[LATENCY_STAGES];
+
+struct latency_histogram {
+	std::atomic<uint64_t> count, sum, max; // ns
+	std::atomic<uint64_t> bucket[LATENCY_BUCKETS];
+};
+
+struct alignas(64) latency_thread {
+	char name[16];
+	std::atomic<uint32_t> used;
+	latency_histogram stage[LATENCY_STAGES];
+};
+
+struct latency_segment {
+	uint32_t magic;   // LATENCY_MAGIC
+	uint32_t version; // LATENCY_VERSION
+	uint32_t stages, buckets, threads;
+	uint32_t pid;
+	std::atomic<uint32_t> registered;
+	latency_thread thread[LATENCY_THREADS];
+};
+
+// plain copy of a histogram, all threads added up
+struct latency_summary {
+	uint64_t count, sum, max;
+	uint64_t bucket[LATENCY_BUCKETS];
+};
+
+// create the segment, in shared memory under name or private if name is 0;
+// if another live process has name, name.<pid> is used instead
+int latency_open(const char* name);
+
+// shared memory name of the segment, 0 if it is private
+const char* latency_name();
+
+// writer handle for the calling thread, 0 if all are taken or nothing is open
+latency_thread* latency_register(const char* name);
+
+// remove the segment again
+void latency_close();
+
+// map the segment of another process read-only, 0 if there is none
+const latency_segment* latency_attach(const char* name);
+
+// the segment of this process, 0 before latency_open()
+const latency_segment* latency_local();
+
+// add up all threads, one summary per stage
+void latency_collect(const latency_segment* seg, latency_summary out[LATENCY_STAGES]);
+
+// value below which fraction p of the recorded values lie, ns
+uint64_t latency_percentile(const latency_summary* s, double p);
+
+// count, mean, p50, p99, p99.9 and max per stage of what was recorded
+// between the two summaries (before may be 0)
+void latency_print(FILE* out, const latency_summary now[LATENCY_STAGES], const latency_summary before[LATENCY_STAGES]);
+
+static inline uint64_t latency_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int latency_bucket(uint64_t ns) {
+	if (ns < (1 << LATENCY_SUB_BITS)) return ns;
+	if (ns >> LATENCY_MAX_BITS) return LATENCY_BUCKETS - 1;
+	int e = 63 - __builtin_clzll(ns);
+	return ((e - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + ((ns >> (e - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1));
+}
+
+// only ever called by the thread owning t, so no read-modify-write is needed
+static inline void latency_add(std::atomic<uint64_t>& counter, uint64_t value) {
+	counter.store(counter.load(std::memory_order_relaxed) + value,std::memory_order_relaxed);
+}
+
+// record a duration in ns, t may be 0
+static inline void latency_record(latency_thread* t, int stage, uint64_t ns) {
+	if (!t) return;
+	latency_histogram& h = t->stage[stage];
+	latency_add(h.bucket[latency_bucket(ns)],1);
+	latency_add(h.sum,ns);
+	if (ns > h.max.load(std::memory_order_relaxed)) h.max.store(ns,std::memory_order_relaxed);
+	latency_add(h.count,1);
+}
+
+#endif
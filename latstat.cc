@@ -0,0 +1,69 @@
+/* NaturalPoint Optitrack latency monitor
+
+  Attaches to the latency histograms of a running viewer (see latency.h)
+  and prints what was recorded in every interval, or everything since
+  the start with -a. Only reads the shared memory, the viewer isn't
+  slowed down by watching it. A viewer started while another one runs
+  uses a name with its pid, pick it with -p.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // atof() etc.
+#include <stdio.h>  // printf() etc.
+#include <unistd.h> // getopt()
+
+#include "latency.h"
+
+void usage(const char* name) {
+	fprintf(stderr,"usage: %s [-a] [-i interval_s] [-n name | -p viewer_pid]\n",name);
+	exit(1);
+}
+
+int main(int argc, char* argv[]) {
+
+	const char* name = LATENCY_SHM;
+	char named[64];
+	double interval = 1;
+	int all = 0, opt;
+
+	while ((opt = getopt(argc,argv,"ai:n:p:")) != -1) {
+		switch (opt) {
+			case 'a': all = 1; break;
+			case 'i': interval = atof(optarg); break;
+			case 'n': name = optarg; break;
+			case 'p': snprintf(named,sizeof(named),"%s.%d",LATENCY_SHM,atoi(optarg)); name = named; break;
+			default: usage(argv[0]);
+		}
+	}
+
+	const latency_segment* seg = latency_attach(name);
+	if (!seg) {
+		fprintf(stderr,"%s: no latency statistics, is the viewer running?\n",name);
+		return 1;
+	}
+
+	static latency_summary now[LATENCY_STAGES], before[LATENCY_STAGES];
+	latency_collect(seg,before);
+
+	for (;;) {
+
+		usleep(interval * 1e6);
+		latency_collect(seg,now);
+
+		printf("pid %u, %s\n",seg->pid,all ? "since start" : "last interval");
+		latency_print(stdout,now,all ? 0 : before);
+		printf("\n");
+		fflush(stdout);
+
+		for (int s = 0; s < LATENCY_STAGES; s++) before[s] = now[s];
+	}
+
+	return 0;
+}
@@ -1,117 +1,103 @@
-#include <usb.h>
-#include <unistd.h>
-#include <stdio.h>
-			
-struct usb_device* getDevice() {
-
-	struct usb_bus *busses;
-
-	usb_init();
-	usb_find_busses();
-	usb_find_devices();
-
-	busses = usb_get_busses();
-		
-	struct usb_bus *bus;
-	//int c, i, a;
-
-	struct usb_device *dev = 0;
-	for (bus = busses; bus; bus = bus->next) {
-
-		for (dev = bus->devices; dev; dev = dev->next) {
-			/* Check if this device is a printer */
-			if ((dev->descriptor.idVendor == 0x131d) && (dev->descriptor.idProduct == 0x0125)) {
-				/* Open the device, claim the interface and do your processing */
-				return dev;
-			}
-
-			/* Loop through all of the configurations 
-			for (c = 0; c < dev->descriptor.bNumConfigurations; c++) {
-				// Loop through all of the interfaces 
-				for (i = 0; i < dev->config[c].bNumInterfaces; i++) {
-					// Loop through all of the alternate settings 
-					for (a = 0; a < dev->config[c].interface[i].num_altsetting; a++) {
-						// Check if this interface is a printer 
-						if (dev->config[c].interface[i].altsetting[a].bInterfaceClass == 7) {
-							// Open the device, set the alternate setting, claim the interface and do your processing 
-							...
-						}
-					}
-				}
-			}*/
+/* NaturalPoint Optitrack capture tool
 
-		}
-	}
-	return 0;
-}
+  Dumps the raw frames of the first camera (or of a recorded stream)
+  to stdout, or with -o into a recording (see record.h) that can be
+  seeked by frame or time. Statistics go to stderr once per second.
 
-static char cmd_set_led[]    = { 0x10, 0x00, 0x00 };
-static char cmd_start_cam[]  = { 0x12 };
-static char cmd_stop_cam[]   = { 0x13 };
-static char cmd_reset[]      = { 0x14, 0x01 };
-static char cmd_set_thresh[] = { 0x15, 0x00, 0x01 };
-static char cmd_get_info[]   = { 0x17 };
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
 
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
 
-int main() {
+*/
 
-	char buffer[4096];
-	int result = 0;
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include <signal.h>
 
-	struct usb_device* dev = getDevice();   if (!dev) return 1;
-	usb_dev_handle* handle = usb_open(dev); if (!handle) return 2;
-	
-	if (usb_claim_interface(handle,0) < 0) return 3;
+#include "capture.h"
+#include "record.h"
 
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
+static volatile sig_atomic_t stop = 0;
 
-	usb_bulk_write(handle,2,cmd_reset,sizeof(cmd_reset),200);
+// finish the recording on ctrl-c instead of leaving it without index
+static void interrupt(int sig) { stop = 1; }
 
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
+void usage(const char* name) {
+	fprintf(stderr,"usage: %s [-t transfers] [-r stream.raw [-f fps]] [-o file.rec [-d]]\n",name);
+	exit(1);
+}
 
-	//cmd_set_led[2] = 0x80; usb_bulk_write(handle,2,cmd_set_led,sizeof(cmd_set_led),200);
-	usb_bulk_write(handle,2,cmd_get_info,sizeof(cmd_get_info),200);
+int main(int argc, char* argv[]) {
+
+	const char* stream = 0;
+	const char* output = 0;
+	int direct = 0;
+	int transfers = 8;
+	int fps = 100;
+	int opt;
+
+	while ((opt = getopt(argc,argv,"t:r:f:o:d")) != -1) {
+		switch (opt) {
+			case 't': transfers = atoi(optarg); break;
+			case 'r': stream = optarg; break;
+			case 'f': fps = atoi(optarg); break;
+			case 'o': output = optarg; break;
+			case 'd': direct = 1; break;
+			default: usage(argv[0]);
+		}
+	}
 
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
+	struct capture* cap = stream ? capture_open_stream(stream,fps) : capture_open_usb(transfers);
+	if (!cap) {
+		fprintf(stderr,"unable to open %s\n",stream ? stream : "camera");
+		return 1;
+	}
 
-	cmd_set_led[1] = cmd_set_led[2] = 0xF0; usb_bulk_write(handle,2,cmd_set_led,sizeof(cmd_set_led),200);
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
+	struct recorder* rec = 0;
+	if (output && !(rec = record_create(output,direct))) {
+		fprintf(stderr,"unable to create %s\n",output);
+		capture_close(cap);
+		return 1;
+	}
 
+	signal(SIGINT,interrupt);
+	signal(SIGTERM,interrupt);
 
-	cmd_reset[1] = 0x00;
-	usb_bulk_write(handle,2,cmd_reset,sizeof(cmd_reset),200);
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
+	capture_start(cap,0,0);
 
-	usb_bulk_write(handle,2,cmd_start_cam,sizeof(cmd_start_cam),200);
+	struct capture_frame frame;
+	time_t last = time(0);
+	int frames = 0, dropped = 0;
+	int result;
 
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
+	while (!stop && (result = capture_next(cap,&frame,1000)) >= 0) {
 
-	/*while (result >= 0) {
-		result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-		write(1,buffer,result);
-		fflush(0);
-	}*/
-	sleep(1);
+		if (result > 0) {
+			if (rec) {
+				if (record_write(rec,0,&frame.header,frame.data) < 0) break;
+			} else if (write(1,frame.data,frame.header.length) < 0) break;
+			frames++;
+			dropped += frame.header.dropped;
+		}
 
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
+		if (time(0) != last) {
+			fprintf(stderr,"frames: %d dropped: %d\n",frames,dropped);
+			frames = dropped = 0;
+			last = time(0);
+		}
+	}
 
-	usb_bulk_write(handle,2,cmd_stop_cam,sizeof(cmd_stop_cam),200);
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
+	capture_close(cap);
 
-	cmd_set_led[1] = 0x00; usb_bulk_write(handle,2,cmd_set_led,sizeof(cmd_set_led),200);
-	result = usb_bulk_read(handle,2,buffer,sizeof(buffer),200);
-	for (int i = 0; i < result; i++) printf("%hhx ",buffer[i]); printf("\n");
+	if (rec && record_close(rec) < 0) {
+		fprintf(stderr,"error writing %s\n",output);
+		return 1;
+	}
 
-	usb_close(handle);
+	return 0;
 }
-
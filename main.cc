@@ -1,27 +1,155 @@
 #include <stdlib.h> // random() etc.
+#include <stddef.h> // offsetof()
 #include <string.h> // strlen() etc.
 #include <stdio.h>  // printf() etc.
 #include <time.h>   // time()
-#include <math.h>   // fabsf()
+#include <math.h>   // sqrt()
 
 #include <unistd.h> // fcntl()
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
+#define GL_GLEXT_PROTOTYPES // glGenBuffers() etc.
 #include <GL/glut.h>
 
+#include <thread>
+#include <atomic>
+
+#include "optitrack.h"
+#include "protocol.h"
+#include "decode.h"
+#include "label.h"
+#include "latency.h"
+
 #define WIDTH 640
 #define HEIGHT 640
 
-unsigned char pixmap[HEIGHT][WIDTH];
+#define MAX_CAMERAS 16
+
+// sensor area shown for each camera, tiles are laid out in a grid
+#define SENSOR_WIDTH  (OPTITRACK_MAX_X + 1)
+#define SENSOR_HEIGHT (OPTITRACK_MAX_Y + 1)
+#define TILE_GAP 4
+
+// regular files can't be watched with epoll, they are replayed at this rate
+#define FILE_FPS 100
+
+// largest frame in a raw stream
+#define FRAME_SIZE 4096
+
+// one decoded frame
+struct result {
+	optitrack_decoded decoded;
+	optitrack_labels labels;
+	unsigned int sequence; // counted by the capture thread
+	uint64_t origin;       // URB completion, or when a raw stream was read
+	uint64_t published;    // handed to the renderer
+};
+
+/*
+  Triple buffer between the capture thread and the renderer: each side
+  owns one slot, the third is swapped in and out atomically together
+  with a flag telling whether it holds a frame the renderer hasn't seen.
+  Capture never waits for the display, and the renderer always gets the
+  latest frame - older ones are overwritten if it falls behind.
+*/
+#define FRESH 4
+
+struct camera {
+
+	const char* name;
+	int fd;
+	int timer;  // paces regular files, -1 otherwise
+	int framed; // every frame starts with struct optitrack_frame as the driver sends it, -1 until known
+
+	// streams are split into frames at the end records or by the frame headers
+	unsigned char buffer[4*FRAME_SIZE];
+	int fill;
+
+	result results[3];
+	std::atomic<int> middle;
+	int back;  // capture thread
+	int front; // renderer
+
+	// counted by the capture thread, shown by the renderer
+	unsigned int sequence;
+	int frames;
+	std::atomic<int> fps;
+	std::atomic<unsigned int> dropped; // reported by the driver
+
+	// renderer: pixmap shown through a texture, rows dirty_top .. dirty_bottom-1 still have to be uploaded
+	unsigned char pixmap[SENSOR_HEIGHT][SENSOR_WIDTH];
+	GLuint texture;
+	int dirty_top, dirty_bottom;
+	unsigned int skipped; // frames the renderer never showed
+	int shown;            // a new frame is on its way to the screen
+};
+
+camera* cameras[MAX_CAMERAS];
+int camera_count = 0;
+int columns = 1, rows = 1;
+
+// per-thread latency histograms, see latency.h
+latency_thread* capture_latency = 0;
+latency_thread* render_latency = 0;
+
+// hand the back slot over and continue with the spare one
+void publish(camera* cam) {
+	cam->results[cam->back].published = latency_now();
+	cam->back = cam->middle.exchange(cam->back | FRESH,std::memory_order_acq_rel) & 3;
+}
+
+bool fresh(camera* cam) {
+	return cam->middle.load(std::memory_order_acquire) & FRESH;
+}
+
+// switch to the latest frame, false if there is none since the last call
+bool latest(camera* cam) {
+	if (!fresh(cam)) return false;
+	unsigned int shown = cam->results[cam->front].sequence;
+	cam->front = cam->middle.exchange(cam->front,std::memory_order_acq_rel) & 3;
+	cam->skipped += cam->results[cam->front].sequence - shown - 1;
+	return true;
+}
+
+void touch(camera* cam, int row) {
+	if (row < cam->dirty_top) cam->dirty_top = row;
+	if (row >= cam->dirty_bottom) cam->dirty_bottom = row + 1;
+}
+
+// top left corner of the tile of camera i
+float tile_x(int i) { return (i % columns) * (SENSOR_WIDTH  + TILE_GAP); }
+float tile_y(int i) { return (i / columns) * (SENSOR_HEIGHT + TILE_GAP); }
+
+// vector mode: runs and centroid crosshairs of all cameras as quads in one vertex buffer, no pixmap at all
+int vector = 0;
+
+#define CROSSHAIR 6
+
+struct vertex {
+	GLfloat x, y;
+	GLubyte r, g, b, a;
+};
+
+vertex vertices[MAX_CAMERAS * 4 * (OPTITRACK_MAX_LINES + 2*OPTITRACK_MAX_BLOBS)];
+int vertex_count = 0;
+int vertices_changed = 0;
+GLuint vertex_buffer;
+
+void quad(float x1, float y1, float x2, float y2, GLubyte r, GLubyte g, GLubyte b) {
+	vertex* v = &vertices[vertex_count];
+	v[0] = { x1, y1, r, g, b, 255 };
+	v[1] = { x2, y1, r, g, b, 255 };
+	v[2] = { x2, y2, r, g, b, 255 };
+	v[3] = { x1, y2, r, g, b, 255 };
+	vertex_count += 4;
+}
 
-void glWindowPos2iINT( GLint x, GLint y ) {
-	glPushAttrib( GL_TRANSFORM_BIT | GL_VIEWPORT_BIT );
-	glMatrixMode( GL_MODELVIEW  ); glPushMatrix(); glLoadIdentity();
-	glMatrixMode( GL_PROJECTION ); glPushMatrix(); glLoadIdentity();
-	glViewport( x-1, y-1, 2, 2 );
-	glRasterPos2i( 0, 0 );
-	glPopMatrix(); glMatrixMode( GL_MODELVIEW ); glPopMatrix();
-	glPopAttrib();
+void text(float x, float y, const char* str) {
+	glRasterPos2f(x,y);
+	for (const char* c = str; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_10,*c);
 }
 
 
@@ -34,14 +162,97 @@ void display() {
   glMatrixMode(GL_MODELVIEW);
   glLoadIdentity();
 
-  glWindowPos2iINT(0,HEIGHT-1);
+  // all tiles in pixel coordinates, row 0 at the top
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0,tile_x(columns-1)+SENSOR_WIDTH,tile_y((rows-1)*columns)+SENSOR_HEIGHT,0,-1,1);
+
+  if (vector) {
+
+    glBindBuffer(GL_ARRAY_BUFFER,vertex_buffer);
+    if (vertices_changed) {
+      glBufferData(GL_ARRAY_BUFFER,vertex_count*sizeof(vertex),vertices,GL_STREAM_DRAW);
+      vertices_changed = 0;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2,GL_FLOAT,sizeof(vertex),(void*)offsetof(vertex,x));
+    glColorPointer(4,GL_UNSIGNED_BYTE,sizeof(vertex),(void*)offsetof(vertex,r));
+    glDrawArrays(GL_QUADS,0,vertex_count);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+
+    // blob ids next to the crosshairs
+    glColor3f(1.0,1.0,0.0);
+    for (int i = 0; i < camera_count; i++) {
+      const optitrack_labels& labels = cameras[i]->results[cameras[i]->front].labels;
+      for (int b = 0; b < labels.count; b++) {
+        char id[16];
+        snprintf(id,sizeof(id),"%d",b);
+        text(tile_x(i) + labels.blobs[b].cx / 256.0f + 0.5f + CROSSHAIR,tile_y(i) + labels.blobs[b].cy / 256.0f + 0.5f - CROSSHAIR,id);
+      }
+    }
+
+  } else {
+
+    glEnable(GL_TEXTURE_2D);
+
+    for (int i = 0; i < camera_count; i++) {
+
+      camera* cam = cameras[i];
+      float x = tile_x(i), y = tile_y(i);
+
+      glBindTexture(GL_TEXTURE_2D,cam->texture);
+
+      // upload the changed rows only
+      if (cam->dirty_bottom > cam->dirty_top) {
+        glTexSubImage2D(GL_TEXTURE_2D,0,0,cam->dirty_top,SENSOR_WIDTH,cam->dirty_bottom-cam->dirty_top,GL_LUMINANCE,GL_UNSIGNED_BYTE,cam->pixmap[cam->dirty_top]);
+        cam->dirty_top = SENSOR_HEIGHT;
+        cam->dirty_bottom = 0;
+      }
+
+      glBegin(GL_QUADS);
+      glTexCoord2f(0,0); glVertex2f(x,y);
+      glTexCoord2f(1,0); glVertex2f(x+SENSOR_WIDTH,y);
+      glTexCoord2f(1,1); glVertex2f(x+SENSOR_WIDTH,y+SENSOR_HEIGHT);
+      glTexCoord2f(0,1); glVertex2f(x,y+SENSOR_HEIGHT);
+      glEnd();
+    }
+
+    glDisable(GL_TEXTURE_2D);
+  }
+
+  uint64_t uploaded = latency_now();
 
-  glPixelZoom(1.0,-1.0);
+  // per-camera statistics in the tile corner
+  glColor3f(1.0,1.0,0.0);
+  for (int i = 0; i < camera_count; i++) {
+    camera* cam = cameras[i];
+    char stats[256];
+    snprintf(stats,sizeof(stats),"%s  %d fps  %u dropped  %u skipped",cam->name,cam->fps.load(),cam->dropped.load(),cam->skipped);
+    text(tile_x(i) + 4,tile_y(i) + 12,stats);
+  }
 
-  glDrawPixels(WIDTH,HEIGHT,GL_LUMINANCE,GL_UNSIGNED_BYTE,pixmap);
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
 
   // redraw
   glutSwapBuffers();
+
+  uint64_t swapped = latency_now();
+  latency_record(render_latency,LATENCY_SWAP,swapped - uploaded);
+
+  for (int i = 0; i < camera_count; i++) {
+    camera* cam = cameras[i];
+    if (!cam->shown) continue;
+    const result& r = cam->results[cam->front];
+    latency_record(render_latency,LATENCY_UPLOAD,uploaded - r.published);
+    latency_record(render_latency,LATENCY_TOTAL,swapped - r.origin);
+    cam->shown = 0;
+  }
 }
 
 
@@ -60,93 +271,276 @@ void resize(int w, int h) {
 }
 
 
-void keyboard(unsigned char key, int x, int y) {
-  switch (key) {
-    case 'q': exit(0); break;
-  }
-}
+// paint the scanlines and blob centroids of a frame
+void draw(camera* cam, const result& r, unsigned char line, unsigned char centroid) {
 
-int last = 0;
-int frame = 0;
+	const optitrack_decoded& decoded = r.decoded;
+	const optitrack_labels& labels = r.labels;
 
-void idle() {
+	for (int i = 0; i < decoded.count; i++)
+		if (decoded.x2[i] > decoded.x1[i]) {
+			memset(&cam->pixmap[decoded.y[i]][decoded.x1[i]],line,decoded.x2[i] - decoded.x1[i]);
+			touch(cam,decoded.y[i]);
+		}
+
+	for (int b = 0; b < labels.count; b++) {
+		cam->pixmap[labels.blobs[b].cy >> 8][labels.blobs[b].cx >> 8] = centroid;
+		touch(cam,labels.blobs[b].cy >> 8);
+	}
+}
 
-	char buffer[10240];
-	//printf("%c[2J\n%c[H\n",27,27);
+// decode one frame and hand it to the renderer, received when read() returned it
+void process(camera* cam, const unsigned char* buffer, int count, uint64_t received) {
 
-	int count = read(0,buffer,sizeof(buffer));
-	if (count <= 0) return;
+	uint64_t origin = received;
 
-	frame++;
-	int curr = glutGet(GLUT_ELAPSED_TIME);
-	int diff = curr - last;
-	if (diff > 1000) {
-		printf("frames: %d\n",frame);
-		frame = 0;
-		last = curr;
+	if (cam->framed) {
+		const optitrack_frame* header = (const optitrack_frame*)buffer;
+		if (count < (int)sizeof(*header)) return;
+		cam->dropped += header->dropped;
+		origin = header->timestamp;
+		latency_record(capture_latency,LATENCY_READ,received - origin);
+		buffer += sizeof(*header);
+		count  -= sizeof(*header);
 	}
 
-	if (buffer[1] != 0x1C) {
-		printf("unknown message\n");
+	cam->frames++;
+
+	if (!optitrack_is_frame(buffer,count)) {
+		printf("%s: unknown message\n",cam->name);
 		return;
 	}
 
-	for (int x = 0; x < WIDTH; x++) for (int y = 0; y < HEIGHT; y++) pixmap[y][x] = 0;
+	result& r = cam->results[cam->back];
+	uint64_t start = latency_now();
+	optitrack_decode(buffer,count,&r.decoded);
+	uint64_t decoded = latency_now();
+	if (r.decoded.out_of_range) printf("%s: out of range\n",cam->name);
+	optitrack_label(&r.decoded,&r.labels);
+	latency_record(capture_latency,LATENCY_DECODE,decoded - start);
+	latency_record(capture_latency,LATENCY_LABEL,latency_now() - decoded);
+	r.sequence = cam->sequence++;
+	r.origin = origin;
+
+	publish(cam);
+}
 
-	int i = 2;
+// a stream from the driver starts with a frame header, a raw one with the
+// byte count of the first USB packet and the frame tag; a raw stream that
+// happens to look like a header is much less likely than the other way round
+int detect(camera* cam) {
 
-	while (i < count) {
+	const optitrack_frame* header = (const optitrack_frame*)cam->buffer;
+	const unsigned char* data = cam->buffer + sizeof(*header);
+	int size = sizeof(*header);
 
-		unsigned char y_  = buffer[i+0];
-		unsigned char x1_ = buffer[i+1];
-		unsigned char x2_ = buffer[i+2];
-		unsigned char in_ = buffer[i+3];
+	if (cam->fill < size + OPTITRACK_RECORD_START) return -1;
+	if (header->length <= FRAME_SIZE && optitrack_is_frame(data,cam->fill-size) && data[0] <= OPTITRACK_PACKET_SIZE) return 1;
+	return 0;
+}
 
-		int y = y_; int x1 = x1_; int x2 = x2_; int in = in_;
-		//printf("record: %x %x %x %x\n",y,x1,x2,in);
+// length of the complete frame at the start of the buffer, 0 if there is none yet
+int frame_length(camera* cam) {
 
-		// in is a bitfield:
-		// 0
-		// 1
-		// 2 = ? \
-		// 3 = ? |- 1 = "next blob" marker
-		// 4 = ? /
-		// 5 = msb of y
-		// 6 = msb of x1
-		// 7 = msb of x2
+	if (cam->framed < 0) {
+		cam->framed = detect(cam);
+		if (cam->framed < 0) return 0;
+		printf("%s: %s stream\n",cam->name,cam->framed ? "framed" : "raw");
+	}
+
+	if (!cam->framed) return optitrack_frame_length(cam->buffer,cam->fill,FRAME_SIZE);
 
-		i += 4;
+	// a broken length only loses the header, process() complains about the rest
+	const optitrack_frame* header = (const optitrack_frame*)cam->buffer;
+	int size = sizeof(*header);
+	if (cam->fill < size) return 0;
+	if (header->length > FRAME_SIZE) return size;
+	return (cam->fill >= size + (int)header->length) ? size + header->length : 0;
+}
 
-		// empty record = end of packet
-		if (!y && !x1 && !x2 && !in) break;
+// read what is available, false once the camera or stream is gone
+bool receive(camera* cam) {
+
+	// paced files get one frame per timer tick, everything else all that's complete;
+	// the driver returns exactly one frame per read
+	int length = frame_length(cam);
+	uint64_t received = latency_now();
+	if (!length || cam->timer < 0) {
+		int count = read(cam->fd,cam->buffer+cam->fill,sizeof(cam->buffer)-cam->fill);
+		if (count < 0 && errno != EAGAIN) return false;
+		if (count > 0) cam->fill += count;
+		received = latency_now();
+		// a stream too short to tell is raw
+		if (count == 0 && cam->framed < 0) cam->framed = 0;
+		if (count == 0 && !(length = frame_length(cam))) return false;
+	}
 
-		// weird superficial "next block" marker?
-		if (in & 0x1F) continue;
+	while ((length = frame_length(cam))) {
+		process(cam,cam->buffer,length,received);
+		memmove(cam->buffer,cam->buffer+length,cam->fill-length);
+		cam->fill -= length;
+		if (cam->timer >= 0) break;
+	}
+
+	return true;
+}
 
-		// adjust MSB
-		if (in & 0x20)  y += 255; 
-		if (in & 0x40) x2 += 255; 
-		if (in & 0x80) x1 += 255; 
+// read and decode frames from all cameras until they are gone, on its own thread
+void capture() {
 
-		// adjust offset
-		y  -= 11;
-		x1 -= 41;
-		x2 -= 41;
+	int ep = epoll_create1(0);
+	int open = 0;
+	time_t last = time(0);
 
-		// safety check
-		if ((y <   0) || (x1 <   0) || (x2 <   0) ||
-		    (y > 289) || (x1 > 356) || (x2 > 356)) {
-			printf("out of range\n");
-			continue;
+	capture_latency = latency_register("capture");
+
+	for (int i = 0; i < camera_count; i++) {
+
+		camera* cam = cameras[i];
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = cam;
+
+		if (epoll_ctl(ep,EPOLL_CTL_ADD,cam->fd,&ev) == 0) {
+			fcntl(cam->fd,F_SETFL,fcntl(cam->fd,F_GETFL) | O_NONBLOCK);
+		} else {
+			// regular file, wake up on a timer instead
+			struct itimerspec period = { { 0, 1000000000 / FILE_FPS }, { 0, 1000000000 / FILE_FPS } };
+			cam->timer = timerfd_create(CLOCK_MONOTONIC,0);
+			timerfd_settime(cam->timer,0,&period,NULL);
+			epoll_ctl(ep,EPOLL_CTL_ADD,cam->timer,&ev);
+		}
+
+		open++;
+	}
+
+	while (open > 0) {
+
+		struct epoll_event events[MAX_CAMERAS];
+		int count = epoll_wait(ep,events,MAX_CAMERAS,1000);
+
+		for (int i = 0; i < count; i++) {
+
+			camera* cam = (camera*)events[i].data.ptr;
+
+			if (cam->timer >= 0) {
+				uint64_t ticks;
+				if (read(cam->timer,&ticks,sizeof(ticks)) < 0) continue;
+			}
+
+			if (!receive(cam)) {
+				printf("%s: end of stream\n",cam->name);
+				epoll_ctl(ep,EPOLL_CTL_DEL,(cam->timer >= 0) ? cam->timer : cam->fd,NULL);
+				open--;
+			}
 		}
 
-		// draw scanline
-		for (int l = x1; l < x2; l++) pixmap[y][l] = 255;
+		if (time(0) != last) {
+			for (int i = 0; i < camera_count; i++) {
+				cameras[i]->fps = cameras[i]->frames;
+				cameras[i]->frames = 0;
+			}
+			last = time(0);
+		}
+	}
+
+	close(ep);
+}
+
+// fill the vertex buffer with the runs and centroid crosshairs of all cameras
+void build() {
+
+	vertex_count = 0;
+
+	for (int c = 0; c < camera_count; c++) {
+
+		const result& r = cameras[c]->results[cameras[c]->front];
+		const optitrack_decoded& decoded = r.decoded;
+		const optitrack_labels& labels = r.labels;
+		float x = tile_x(c), y = tile_y(c);
+
+		for (int i = 0; i < decoded.count; i++)
+			if (decoded.x2[i] > decoded.x1[i])
+				quad(x+decoded.x1[i],y+decoded.y[i],x+decoded.x2[i],y+decoded.y[i]+1,255,255,255);
+
+		// centroids are pixel centers in 1/256, pixel x covers x .. x+1 on screen
+		for (int b = 0; b < labels.count; b++) {
+			float cx = x + labels.blobs[b].cx / 256.0f + 0.5f, cy = y + labels.blobs[b].cy / 256.0f + 0.5f;
+			quad(cx-CROSSHAIR,cy-0.5f,cx+CROSSHAIR,cy+0.5f,255,0,0);
+			quad(cx-0.5f,cy-CROSSHAIR,cx+0.5f,cy+CROSSHAIR,255,0,0);
+		}
+	}
+
+	vertices_changed = 1;
+}
+
+void idle() {
+
+	static time_t last = 0;
+	bool changed = false;
+
+	for (int i = 0; i < camera_count; i++) {
+
+		camera* cam = cameras[i];
+		if (!fresh(cam)) continue;
+
+		if (vector) {
+			latest(cam);
+		} else {
+			// only clear what the previous frame drew, it is still in the front slot
+			draw(cam,cam->results[cam->front],0,0);
+			latest(cam);
+			draw(cam,cam->results[cam->front],255,128);
+		}
+
+		cam->shown = 1;
+
+		changed = true;
+	}
+
+	if (changed && vector) build();
+
+	// statistics change once per second even without frames
+	if (time(0) != last) {
+		last = time(0);
+		changed = true;
+	}
+
+	// nothing new, don't spin
+	if (!changed) {
+		usleep(1000);
+		return;
 	}
 
 	glutPostRedisplay();
 }
 
+void keyboard(unsigned char key, int x, int y) {
+  switch (key) {
+    case 'q': exit(0); break;
+    case 'v':
+      // the pixmaps aren't kept up to date in vector mode, start over
+      vector = !vector;
+      if (vector) build();
+      else for (int i = 0; i < camera_count; i++) {
+        camera* cam = cameras[i];
+        memset(cam->pixmap,0,sizeof(cam->pixmap));
+        touch(cam,0); touch(cam,SENSOR_HEIGHT-1);
+        draw(cam,cam->results[cam->front],255,128);
+      }
+      printf("%s mode\n",vector ? "vector" : "image");
+      glutPostRedisplay();
+      break;
+    case 'l': {
+      // everything since the start
+      static latency_summary total[LATENCY_STAGES];
+      latency_collect(latency_local(),total);
+      latency_print(stdout,total,0);
+      break;
+    }
+  }
+}
+
 
 
 // initialize the GLUT library
@@ -175,6 +569,21 @@ void initGL() {
 	glPixelStorei( GL_PACK_ALIGNMENT,   1 );
 	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
 
+  // persistent texture for each pixmap, updated in display()
+  for (int i = 0; i < camera_count; i++) {
+    camera* cam = cameras[i];
+    glGenTextures(1,&cam->texture);
+    glBindTexture(GL_TEXTURE_2D,cam->texture);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_LUMINANCE,SENSOR_WIDTH,SENSOR_HEIGHT,0,GL_LUMINANCE,GL_UNSIGNED_BYTE,cam->pixmap);
+  }
+  glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_REPLACE);
+
+  glGenBuffers(1,&vertex_buffer);
+
    // misc stuff
   glDisable(GL_LIGHTING);
   glDisable(GL_CULL_FACE);
@@ -182,26 +591,90 @@ void initGL() {
 
 
 
+// a camera device, stream or "-" for stdin; framed is 1 for the driver's
+// frame headers, 0 for raw camera data and -1 to tell from the data
+camera* open_camera(const char* path, int framed) {
+
+	camera* cam = new camera();
+
+	cam->name = path;
+	cam->fd = strcmp(path,"-") ? open(path,O_RDONLY) : STDIN_FILENO;
+	if (cam->fd < 0) {
+		perror(path);
+		exit(1);
+	}
+
+	cam->framed = framed;
+	cam->timer = -1;
+	cam->sequence = 1; // 0 is the empty slot the renderer starts with
+	cam->middle = 2;
+	cam->back = 0;
+	cam->front = 1;
+	cam->dirty_top = SENSOR_HEIGHT;
+	cam->dirty_bottom = 0;
+
+	return cam;
+}
+
+// print the latencies of the last interval every few seconds, on its own thread
+void report(double interval) {
+
+	static latency_summary now[LATENCY_STAGES], before[LATENCY_STAGES];
+	latency_collect(latency_local(),before);
+
+	for (;;) {
+		usleep(interval * 1e6);
+		latency_collect(latency_local(),now);
+		latency_print(stdout,now,before);
+		for (int s = 0; s < LATENCY_STAGES; s++) before[s] = now[s];
+	}
+}
+
 int main(int argc, char* argv[]) {
 
-  // unblock stdin
-  /*flags = fcntl(STDIN_FILENO,F_GETFL);
-  flags |= O_NONBLOCK;
-  fcntl(STDIN_FILENO,F_SETFL,flags);*/
+  double interval = 0;
 
   // lots of other init stuff
   initGLUT(&argc,argv);
+
+  // latencies can be watched with latstat, private if the shared memory isn't available
+  if (latency_open(LATENCY_SHM) < 0) latency_open(0);
+  else if (strcmp(latency_name(),LATENCY_SHM)) printf("latency statistics in %s, another viewer has %s\n",latency_name(),LATENCY_SHM);
+  atexit(latency_close);
+  render_latency = latency_register("render");
+
+  // cameras or streams to show, stdin if none are given; -l s prints the latencies every s seconds,
+  // -f / -r read the following streams as framed by the driver / raw camera data instead of guessing
+  int framed = -1;
+  for (int i = 1; i < argc && camera_count < MAX_CAMERAS; i++) {
+    if (!strcmp(argv[i],"-l") && i + 1 < argc) interval = atof(argv[++i]);
+    else if (!strcmp(argv[i],"-f")) framed = 1;
+    else if (!strcmp(argv[i],"-r")) framed = 0;
+    else cameras[camera_count++] = open_camera(argv[i],framed);
+  }
+  if (camera_count == 0) cameras[camera_count++] = open_camera("-",framed);
+
+  columns = ceil(sqrt(camera_count));
+  rows = (camera_count + columns - 1) / columns;
+
   initGL();
-  
+
   // make functions known to GLUT
   glutKeyboardFunc(keyboard);
   glutDisplayFunc(display);
   glutReshapeFunc(resize);
   glutIdleFunc(idle);
 
+  std::thread reader(capture);
+  reader.detach();
+
+  if (interval > 0) {
+    std::thread reporter(report,interval);
+    reporter.detach();
+  }
+
   // start the action
   glutMainLoop();
   
   return 0;
 }
-
@@ -13,6 +13,14 @@ INTERFACE_ID = 0
 BULK_IN_EP = 2
 BULK_OUT_EP = 2
 
+# command opcodes, keep in sync with protocol.h
+CMD_SET_LED    = 0x10
+CMD_START      = 0x12
+CMD_STOP       = 0x13
+CMD_RESET      = 0x14
+CMD_SET_THRESH = 0x15
+CMD_GET_INFO   = 0x17
+
 def getDevice():
 	buses = usb.busses()
 	for bus in buses :
@@ -41,12 +49,12 @@ def main(argv=None):
 
 	time.sleep(1)
 
-	sendMessage(handle,chr(0x14)+chr(0x01)) # reset, maybe?
+	sendMessage(handle,chr(CMD_RESET)+chr(0x01)) # reset, maybe?
 
-	sendMessage(handle,chr(0x10)+chr(0x00)+chr(0x80)) # turn leds off
-	sendMessage(handle,chr(0x10)+chr(0x00)+chr(0x20))
+	sendMessage(handle,chr(CMD_SET_LED)+chr(0x00)+chr(0x80)) # turn leds off
+	sendMessage(handle,chr(CMD_SET_LED)+chr(0x00)+chr(0x20))
 
-	sendMessage(handle,chr(0x17)) # maybe get serial command?
+	sendMessage(handle,chr(CMD_GET_INFO)) # maybe get serial command?
 
 	time.sleep(1)
 	#print getMessage(handle,4096) # two reads only once after powerup, first one returns 6 bytes
@@ -55,16 +63,16 @@ def main(argv=None):
 
 	time.sleep(1)
 
-	sendMessage(handle,chr(0x10)+chr(0x10)+chr(0x10)) # enable led 1
-	sendMessage(handle,chr(0x10)+chr(0x20)+chr(0x20)) # enable led 2
-	sendMessage(handle,chr(0x10)+chr(0x40)+chr(0x40)) # enable led 3
-	sendMessage(handle,chr(0x10)+chr(0x80)+chr(0x80)) # enable led 4
+	sendMessage(handle,chr(CMD_SET_LED)+chr(0x10)+chr(0x10)) # enable led 1
+	sendMessage(handle,chr(CMD_SET_LED)+chr(0x20)+chr(0x20)) # enable led 2
+	sendMessage(handle,chr(CMD_SET_LED)+chr(0x40)+chr(0x40)) # enable led 3
+	sendMessage(handle,chr(CMD_SET_LED)+chr(0x80)+chr(0x80)) # enable led 4
 
 	time.sleep(1)
 
-	sendMessage(handle,chr(0x14)+chr(0x00)) # reset? wipe sensor?
+	sendMessage(handle,chr(CMD_RESET)+chr(0x00)) # reset? wipe sensor?
 
-	sendMessage(handle,chr(0x12)) # start command (presumably)
+	sendMessage(handle,chr(CMD_START)) # start command (presumably)
 
 	i = 0
 	while i < 2:
@@ -75,7 +83,7 @@ def main(argv=None):
 			str = str + chr(s)
 		os.write(1,str)
 
-	sendMessage(handle,chr(0x13)) # stop command (presumably)
+	sendMessage(handle,chr(CMD_STOP)) # stop command (presumably)
 
 main()
 
@@ -20,9 +20,35 @@
 #include <linux/module.h>
 #include <linux/completion.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/version.h>
 #include <asm/uaccess.h>
 #include <linux/usb.h>
 
+#include "optitrack.h"
+#include "protocol.h"
+
+/* vm_flags became read-only in 6.3, older kernels lack the accessors */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 3, 0)
+static inline void vm_flags_clear(struct vm_area_struct *vma, unsigned long flags)
+{
+	vma->vm_flags &= ~flags;
+}
+#endif
+
 /* version information */
 #define DRIVER_VERSION "0.1"
 #define DRIVER_SHORT   "optitrack"
@@ -42,41 +68,128 @@ static struct usb_device_id optitrack_table[] = {
 	{}
 };
 
-/* camera commands */
-static char cmd_set_led[]    = { 0x10, 0x00, 0x00 };
-static char cmd_start_cam[]  = { 0x12 };
-static char cmd_stop_cam[]   = { 0x13 };
-static char cmd_reset[]      = { 0x14, 0x01 };
-static char cmd_set_thresh[] = { 0x15, 0x00, 0x01 };
-static char cmd_get_info[]   = { 0x17 };
+/* largest command we ever send */
+#define CMD_BUFFER_SIZE 8
+
+/* how long to wait for the reply to OPTITRACK_CMD_GET_INFO, slow cameras need about a second */
+#define INFO_TIMEOUT HZ
+
+/* ring buffer parameters */
+static unsigned int ring_depth = 32;
+module_param(ring_depth, uint, S_IRUGO);
+MODULE_PARM_DESC(ring_depth, "Number of frames buffered per camera");
+
+static unsigned int num_urbs = 4;
+module_param(num_urbs, uint, S_IRUGO);
+MODULE_PARM_DESC(num_urbs, "Number of bulk-in URBs kept in flight per camera");
 
 MODULE_DEVICE_TABLE(usb, optitrack_table);
 static DEFINE_MUTEX(open_disc_mutex);
 
+/* runs the camera handshakes, one work item per camera in parallel */
+static struct workqueue_struct *optitrack_wq;
+
+/* debugfs directory with one subdirectory per camera, may be NULL */
+static struct dentry *optitrack_debugfs;
+
+/* failed transfers are counted by status, anything else goes into the last one;
+   same order as the attributes in the errors group below */
+static const int optitrack_error_status[] = { -EPROTO, -EILSEQ, -ETIME, -EOVERFLOW, -EPIPE };
+#define OPTITRACK_ERRORS (ARRAY_SIZE(optitrack_error_status) + 1)
+
+/* completion-to-read latency, bucket n holds 2^(n-1) .. 2^n us, the last one everything above */
+#define OPTITRACK_LATENCY_BUCKETS 24
+
+/*
+  Statistics are kept per CPU, so the completion handler and read() only
+  ever touch counters nobody else writes, without locks or shared cache
+  lines. They are only added up when somebody looks at them.
+*/
+struct optitrack_stats {
+	u64 frames; /* frames put into the ring */
+	u64 bytes; /* camera data in those frames */
+	u64 empty; /* transfers without any data */
+	u64 truncated; /* frames not ending with an end record */
+	u64 overruns; /* frames overwritten because the ring was full */
+	u64 resubmit_errors; /* URBs that could not be resubmitted and are gone */
+	u64 errors[OPTITRACK_ERRORS]; /* failed transfers by status */
+	u64 reads; /* frames returned by read() */
+	u64 latency_sum; /* ns from completion to read() */
+	u64 latency[OPTITRACK_LATENCY_BUCKETS];
+};
+
 /* structure to hold all of our device specific stuff */
 struct usb_optitrack {
 
 	struct usb_device *udev; /* save off the usb device pointer */
 	struct usb_interface *interface; /* the interface for this device */
 
-	unsigned char *bulk_in_buffer; /* the buffer to receive data */
 	size_t bulk_in_size; /* the maximum bulk packet size */
 	size_t bulk_out_size; /* same as above, output endpoint */
 	__u8 bulk_in_endpointAddr; /* the address of the bulk in endpoint */
 	__u8 bulk_out_endpointAddr; /* the address of the bulk out endpoint */
 
-	int open; /* if the port is open or not */
+	int open; /* number of open files */
 	int present; /* if the device is not disconnected */
 	int serial; /* serial number of camera */
-	int data_size; /* bytes from last bulk-in transfer */
+	unsigned char info[OPTITRACK_INFO_SIZE]; /* reply to OPTITRACK_CMD_GET_INFO */
+	unsigned char *cmd_buffer; /* DMA-safe buffer for outgoing commands */
 	struct mutex lock; /* locks this structure */
 
+	struct work_struct init_work; /* camera handshake, run after probe */
+	struct completion ready; /* handshake done, open() waits for this */
+	struct completion info_done; /* reply to OPTITRACK_CMD_GET_INFO received */
+
+	struct urb **urbs; /* bulk-in URBs, kept in flight until disconnect */
+	struct usb_anchor stalled; /* URBs waiting for halt_work to clear the stall */
+	struct work_struct halt_work; /* clears a stalled bulk-in endpoint */
+	int streaming; /* if the camera has been started */
+
+	struct optitrack_ring *ring; /* shared header, followed by the frame slots */
+	size_t ring_size; /* total size of the ring mapping */
+	unsigned int lost; /* failed transfers since the last frame */
+	spinlock_t ring_lock; /* protects the ring against the completion handler */
+	wait_queue_head_t wait; /* readers waiting for the next frame */
+	struct list_head readers; /* open files, protected by lock */
+	int blob_readers; /* files in OPTITRACK_MODE_BLOBS, protected by lock */
+	struct optitrack_run *runs; /* scratch space for blob detection */
+
+	struct optitrack_stats __percpu *stats; /* counters, see optitrack_stat() */
+	u64 closed_drops; /* frames dropped by readers already released, protected by ring_lock */
+	struct dentry *debugfs; /* this camera's debugfs directory */
+
+};
+
+/* one decoded scanline, used while grouping scanlines into blobs */
+struct optitrack_run {
+	short y, x1, x2;
+	unsigned short parent; /* union-find link to another run of the blob */
+	short blob; /* index into the blob array, -1 if not assigned yet */
+};
+
+/* per-file state, every reader walks the ring at its own pace */
+struct optitrack_reader {
+
+	struct usb_optitrack *dev; /* the device this file belongs to */
+	struct list_head list; /* entry in dev->readers */
+	struct mutex lock; /* serializes read() on this file */
+
+	unsigned int cursor; /* next frame to be returned by read() */
+	unsigned int dropped; /* frames overwritten before they were read */
+	unsigned int missed; /* same, since the last read() */
+	int mode; /* OPTITRACK_MODE_RAW or OPTITRACK_MODE_BLOBS */
+	pid_t pid; /* process that opened the file, for debugfs */
+
 };
 
 /* local function prototypes */
 static ssize_t optitrack_read(struct file *file, char __user *buffer,
 				size_t count, loff_t * ppos);
 
+static unsigned int optitrack_poll(struct file *file, poll_table *wait);
+static int optitrack_mmap(struct file *file, struct vm_area_struct *vma);
+static long optitrack_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+
 static int optitrack_open(struct inode *inode, struct file *file);
 static int optitrack_release(struct inode *inode, struct file *file);
 
@@ -89,6 +202,9 @@ static void optitrack_disconnect(struct usb_interface *interface);
 static const struct file_operations optitrack_fops = {
 	.owner = THIS_MODULE,
 	.read = optitrack_read,
+	.poll = optitrack_poll,
+	.mmap = optitrack_mmap,
+	.unlocked_ioctl = optitrack_ioctl,
 	.open = optitrack_open,
 	.release = optitrack_release,
 };
@@ -108,109 +224,367 @@ static struct usb_driver optitrack_driver = {
 	.id_table = optitrack_table,
 };
 
-static void optitrack_bulk_cb(struct urb* urb) {
-	printk("read callback: status %d actual_length %d\n",urb->status,urb->actual_length);
+/* header of frame n, the camera data follows it */
+static inline struct optitrack_frame *optitrack_slot(struct usb_optitrack *dev, unsigned int n)
+{
+	return (struct optitrack_frame *)((unsigned char *)dev->ring +
+		dev->ring->header_size + (n % ring_depth) * dev->ring->slot_size);
+}
+
+static inline unsigned int optitrack_find_root(struct optitrack_run *runs, unsigned int i)
+{
+	while (runs[i].parent != i) {
+		runs[i].parent = runs[runs[i].parent].parent;
+		i = runs[i].parent;
+	}
+	return i;
+}
+
+/* decode the scanlines of a frame and group overlapping ones into blobs */
+static unsigned int optitrack_find_blobs(struct usb_optitrack *dev,
+	const unsigned char *data, unsigned int length, struct optitrack_blob *blobs)
+{
+	struct optitrack_run *runs = dev->runs;
+	struct optitrack_run *run;
+	struct optitrack_blob *blob;
+	unsigned int count = 0, prev = 0, curr = 0;
+	unsigned int i, j, a, b, area, nblobs = 0;
+	int y, x1, x2, type;
+
+	for (i = OPTITRACK_RECORD_START; i + OPTITRACK_RECORD_SIZE <= length;
+			i += OPTITRACK_RECORD_SIZE) {
+
+		type = optitrack_decode_record(data + i, &y, &x1, &x2);
+
+		if (type == OPTITRACK_RECORD_END)
+			break;
+
+		/* fillers, lines outside the sensor and empty lines */
+		if ((type != OPTITRACK_RECORD_LINE) || (x2 <= x1))
+			continue;
+
+		/* runs arrive row by row, remember where the last two rows start */
+		if ((count == 0) || (y != runs[count-1].y)) {
+			prev = (count && (y == runs[count-1].y + 1)) ? curr : count;
+			curr = count;
+		}
+
+		run = &runs[count];
+		run->y = y; run->x1 = x1; run->x2 = x2;
+		run->parent = count;
+		run->blob = -1;
+
+		/* merge with all touching runs in the row above */
+		for (j = prev; j < curr; j++) {
+			if ((runs[j].x1 > x2) || (runs[j].x2 < x1))
+				continue;
+			a = optitrack_find_root(runs, j);
+			b = optitrack_find_root(runs, count);
+			if (a != b)
+				runs[b].parent = a;
+		}
+
+		count++;
+	}
+
+	/* accumulate area, coordinate sums and bounding box per blob */
+	for (i = 0; i < count; i++) {
+
+		run = &runs[optitrack_find_root(runs, i)];
+		if (run->blob < 0) {
+			if (nblobs == OPTITRACK_MAX_BLOBS)
+				continue;
+			run->blob = nblobs++;
+			blob = &blobs[run->blob];
+			memset(blob, 0, sizeof(*blob));
+			blob->x1 = OPTITRACK_MAX_X; blob->y1 = OPTITRACK_MAX_Y;
+		}
+		blob = &blobs[run->blob];
+
+		run  = &runs[i];
+		area = run->x2 - run->x1;
+		blob->area += area;
+		blob->cx += area * (run->x1 + run->x2 - 1); /* twice the x sum */
+		blob->cy += area * run->y;
+
+		if (run->x1 < blob->x1) blob->x1 = run->x1;
+		if (run->x2 > blob->x2) blob->x2 = run->x2;
+		if (run->y < blob->y1) blob->y1 = run->y;
+		if (run->y >= blob->y2) blob->y2 = run->y + 1;
+	}
+
+	/* turn sums into centroids */
+	for (i = 0; i < nblobs; i++) {
+		blob = &blobs[i];
+		blob->cx = div_u64((u64)blob->cx * 128, blob->area);
+		blob->cy = div_u64((u64)blob->cy * 256, blob->area);
+	}
+
+	return nblobs;
+}
+
+static void optitrack_count_error(struct usb_optitrack *dev, int status)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(optitrack_error_status); i++)
+		if (status == optitrack_error_status[i])
+			break;
+
+	this_cpu_inc(dev->stats->errors[i]);
+}
+
+/* a frame that fits into one transfer ends with the end record, look only there */
+static inline int optitrack_frame_complete(const unsigned char *data, unsigned int length)
+{
+	const unsigned char *last = data + length - OPTITRACK_RECORD_SIZE;
+
+	if ((length < OPTITRACK_RECORD_START + OPTITRACK_RECORD_SIZE) ||
+	    ((length - OPTITRACK_RECORD_START) % OPTITRACK_RECORD_SIZE))
+		return 0;
+
+	return !last[0] && !last[1] && !last[2] && !last[3];
+}
+
+/* put an URB back in flight, one that can't be is counted and logged */
+static void optitrack_resubmit(struct usb_optitrack *dev, struct urb *urb, gfp_t flags)
+{
+	int result = usb_submit_urb(urb, flags);
+
+	/* poisoned or unplugged, the driver is shutting down */
+	if (!result || (result == -EPERM) || (result == -ENODEV))
+		return;
+
+	this_cpu_inc(dev->stats->resubmit_errors);
+	dev_err_ratelimited(&dev->interface->dev, "unable to resubmit bulk-in URB (error %d)\n", result);
+}
+
+static void optitrack_bulk_cb(struct urb *urb)
+{
+	struct usb_optitrack *dev = urb->context;
+	struct optitrack_ring *ring = dev->ring;
+	struct optitrack_frame *frame;
+	unsigned long flags;
+	ktime_t now = ktime_get();
+
+	switch (urb->status) {
+	case 0:
+		break;
+	case -ENOENT:
+	case -ECONNRESET:
+	case -ESHUTDOWN:
+		/* killed, don't resubmit */
+		return;
+	case -EPIPE:
+		/* stalled, resubmitted from halt_work once the halt is cleared */
+		optitrack_count_error(dev, urb->status);
+		spin_lock_irqsave(&dev->ring_lock, flags);
+		dev->lost++;
+		spin_unlock_irqrestore(&dev->ring_lock, flags);
+		usb_anchor_urb(urb, &dev->stalled);
+		queue_work(optitrack_wq, &dev->halt_work);
+		return;
+	default:
+		/* whatever was in this transfer is gone */
+		optitrack_count_error(dev, urb->status);
+		spin_lock_irqsave(&dev->ring_lock, flags);
+		dev->lost++;
+		spin_unlock_irqrestore(&dev->ring_lock, flags);
+		goto resubmit;
+	}
+
+	if (urb->actual_length == 0) {
+		this_cpu_inc(dev->stats->empty);
+		goto resubmit;
+	}
+
+	spin_lock_irqsave(&dev->ring_lock, flags);
+
+	/* the info reply is the only message we are waiting for */
+	if ((urb->actual_length == OPTITRACK_INFO_SIZE) &&
+	    !optitrack_is_frame(urb->transfer_buffer, urb->actual_length)) {
+		memcpy(dev->info, urb->transfer_buffer, OPTITRACK_INFO_SIZE);
+		dev->serial = (dev->info[5] << 8) + dev->info[6];
+		spin_unlock_irqrestore(&dev->ring_lock, flags);
+		complete(&dev->info_done);
+		goto resubmit;
+	}
+
+	/* ring is full, overwrite the oldest frame - readers notice on their own */
+	if (ring->head - ring->tail >= ring_depth) {
+		ring->tail++;
+		this_cpu_inc(dev->stats->overruns);
+	}
+
+	/* mark the slot busy for mmap readers while it is being written */
+	frame = optitrack_slot(dev, ring->head);
+	frame->sequence = OPTITRACK_SEQ_BUSY;
+	smp_wmb();
+
+	frame->timestamp = ktime_to_ns(now);
+	frame->length = urb->actual_length;
+	frame->dropped = dev->lost;
+	dev->lost = 0;
+	memcpy(frame + 1, urb->transfer_buffer, urb->actual_length);
+
+	/* only pay for blob detection if somebody wants the result */
+	frame->blobs = 0;
+	if (dev->blob_readers)
+		frame->blobs = optitrack_find_blobs(dev,
+			urb->transfer_buffer, urb->actual_length,
+			(struct optitrack_blob *)((unsigned char *)frame + ring->blob_offset));
+	smp_wmb();
+
+	frame->sequence = ring->head;
+	smp_wmb();
+	ring->head++;
+
+	spin_unlock_irqrestore(&dev->ring_lock, flags);
+
+	this_cpu_inc(dev->stats->frames);
+	this_cpu_add(dev->stats->bytes, urb->actual_length);
+	if (!optitrack_frame_complete(urb->transfer_buffer, urb->actual_length))
+		this_cpu_inc(dev->stats->truncated);
+
+	wake_up_interruptible(&dev->wait);
+
+resubmit:
+	optitrack_resubmit(dev, urb, GFP_ATOMIC);
+}
+
+/* send a command, built in the per-device buffer */
+static int optitrack_command(struct usb_optitrack *dev, int opcode,
+				int param1, int param2)
+{
+	int bytes_written;
+	int size;
+
+	size = optitrack_build_command(dev->cmd_buffer, opcode, param1, param2);
+
+	return usb_bulk_msg(dev->udev,
+		usb_sndbulkpipe(dev->udev, dev->bulk_out_endpointAddr),
+		dev->cmd_buffer, size, &bytes_written, HZ);
 }
 
-#define optitrack_command(dev, buffer, sent) \
-	usb_bulk_msg( \
-		dev->udev, \
-		usb_sndbulkpipe( dev->udev, dev->bulk_out_endpointAddr ), \
-		buffer, \
-		sizeof(buffer), \
-		&sent, \
-		HZ \
-	)
+#define optitrack_simple_command(dev, opcode) \
+	optitrack_command(dev, opcode, 0, 0)
+
+#define optitrack_set_led(dev, state, mask) \
+	optitrack_command(dev, OPTITRACK_CMD_SET_LED, state, mask)
+
+#define optitrack_reset(dev, mode) \
+	optitrack_command(dev, OPTITRACK_CMD_RESET, mode, 0)
 
-/*int optitrack_do_command(struct usb_optitrack *dev, unsigned char* buffer, int size, int* sent) {
-	struct urb* mysendurb = usb_alloc_urb(0,GFP_KERNEL);
+#define optitrack_set_thresh(dev, thresh) \
+	optitrack_command(dev, OPTITRACK_CMD_SET_THRESH, \
+		((thresh) >> 8) & 0xFF, (thresh) & 0xFF)
+
+/* queue all bulk-in URBs, they are resubmitted until killed */
+static int optitrack_submit_urbs(struct usb_optitrack *dev)
+{
 	int result = 0;
-	printk("submitting urb..\n");
-	usb_fill_bulk_urb( mysendurb, dev->udev, usb_sndbulkpipe( dev->udev, dev->bulk_out_endpointAddr ), buffer, size, optitrack_bulk_cb, dev );
-	result = usb_submit_urb(mysendurb,GFP_KERNEL);
-	printk("..done.\n");
-	*sent = 0;
-	usb_free_urb(mysendurb);
+	int i;
+
+	for (i = 0; i < num_urbs; i++) {
+		result = usb_submit_urb(dev->urbs[i], GFP_KERNEL);
+		if (result) {
+			err("Unable to submit bulk-in URB (error %d).", result);
+			break;
+		}
+	}
+
 	return result;
 }
 
-#define optitrack_command(dev,buffer,sent) optitrack_do_command(dev,buffer,sizeof(buffer),&sent)*/
+/* for good: poisoned URBs refuse to be resubmitted, also by halt_work */
+static void optitrack_kill_urbs(struct usb_optitrack *dev)
+{
+	int i;
+
+	for (i = 0; i < num_urbs; i++)
+		usb_poison_urb(dev->urbs[i]);
+
+	cancel_work_sync(&dev->halt_work);
+	usb_scuttle_anchored_urbs(&dev->stalled);
+}
+
+/* the bulk-in endpoint stalled: clear the halt and restart the URBs it took out */
+static void optitrack_halt_work(struct work_struct *work)
+{
+	struct usb_optitrack *dev =
+		container_of(work, struct usb_optitrack, halt_work);
+	struct urb *urb;
+	int result;
+
+	result = usb_clear_halt(dev->udev, usb_rcvbulkpipe(dev->udev, dev->bulk_in_endpointAddr));
+	if (result)
+		dev_err(&dev->interface->dev, "unable to clear stalled endpoint (error %d)\n", result);
+	else
+		dev_warn_ratelimited(&dev->interface->dev, "bulk-in endpoint stalled, cleared\n");
+
+	/* resubmit even if clearing failed, they stall again and bring us back here */
+	while ((urb = usb_get_from_anchor(&dev->stalled))) {
+		optitrack_resubmit(dev, urb, GFP_KERNEL);
+		usb_free_urb(urb);
+	}
+}
+
+/* ask for the info reply and wait until the completion handler has it */
+static int optitrack_query_info(struct usb_optitrack *dev)
+{
+	int result;
+
+	/* a late reply to an earlier query may be completing it right now */
+	reinit_completion(&dev->info_done);
+
+	result = optitrack_simple_command(dev, OPTITRACK_CMD_GET_INFO);
+	if (result < 0)
+		return result;
+
+	if (!wait_for_completion_timeout(&dev->info_done, INFO_TIMEOUT))
+		return -ETIMEDOUT;
+
+	return 0;
+}
 
 static int optitrack_init(struct usb_optitrack *dev)
 {
-	int bytes_read = 0;
-	int bytes_written;
 	int result = 0;
 
-	struct urb* myrecvurb;
-	if (optitrack_command(dev, cmd_reset, bytes_written) < 0)
-		goto reset;
-
-	cmd_set_led[1] = 0x00; cmd_set_led[2] = 0x80;
-	if (optitrack_command(dev, cmd_set_led, bytes_written) < 0)
-		goto reset;
+	dev->serial = -1;
 
-	cmd_set_led[1] = 0x00; cmd_set_led[2] = 0x20;
-	if (optitrack_command(dev, cmd_set_led, bytes_written) < 0)
+	result = optitrack_reset(dev, 0x01);
+	if (result < 0)
 		goto reset;
 
-	if (optitrack_command(dev, cmd_get_info, bytes_written) < 0)
+	/* switch off all LEDs */
+	result = optitrack_set_led(dev, 0x00, 0x80);
+	if (result < 0)
 		goto reset;
 
-	msleep(1000);
-	result = usb_bulk_msg (dev->udev,
-		usb_rcvbulkpipe (dev->udev, dev->bulk_in_endpointAddr),
-		dev->bulk_in_buffer,
-		dev->bulk_in_size, &bytes_read, HZ);
-
-	/*msleep(1000);
-	result = usb_bulk_msg (dev->udev,
-		usb_rcvbulkpipe (dev->udev, dev->bulk_in_endpointAddr),
-		dev->bulk_in_buffer,
-		dev->bulk_in_size, &bytes_read, HZ);*/
-
-	/*printk("submitting urb..\n");
-	myrecvurb = usb_alloc_urb(0,GFP_KERNEL);
-	usb_fill_bulk_urb( myrecvurb, dev->udev, usb_rcvbulkpipe( dev->udev, dev->bulk_in_endpointAddr ), dev->bulk_in_buffer, dev->bulk_in_size, optitrack_bulk_cb, dev );
-	result = usb_submit_urb(myrecvurb,GFP_KERNEL);
-	usb_free_urb(myrecvurb);
-	printk("..done.\n");
-
-	msleep(1000);
-
-	printk("submitting urb..\n");
-	myrecvurb = usb_alloc_urb(0,GFP_KERNEL);
-	usb_fill_bulk_urb( myrecvurb, dev->udev, usb_rcvbulkpipe( dev->udev, dev->bulk_in_endpointAddr ), dev->bulk_in_buffer, dev->bulk_in_size, optitrack_bulk_cb, dev );
-	result = usb_submit_urb(myrecvurb,GFP_KERNEL);
-	usb_free_urb(myrecvurb);
-	printk("..done.\n");*/
-
-	msleep(1000);
-
-	if (!result && (bytes_read == 9)) {
-		dev->serial = 
-			(dev->bulk_in_buffer[5] << 8) +
-			 dev->bulk_in_buffer[6];
-	} else {
-		dev->serial = -bytes_read;
-	}
-
-	cmd_set_led[1] = cmd_set_led[2] = 0xF0;
-	if (optitrack_command(dev, cmd_set_led, bytes_written) < 0)
+	result = optitrack_set_led(dev, 0x00, 0x20);
+	if (result < 0)
 		goto reset;
 
-	cmd_reset[1] = 0x00;
-	if (optitrack_command(dev, cmd_reset, bytes_written) < 0)
+	/* replies and frames arrive through the URBs from now on */
+	result = optitrack_submit_urbs(dev);
+	if (result < 0)
 		goto reset;
 
-	if (optitrack_command(dev, cmd_start_cam, bytes_written) < 0)
+	/* a camera that doesn't answer still streams, serial stays -1 */
+	result = optitrack_query_info(dev);
+	if (result == -ETIMEDOUT)
+		dev_warn(&dev->interface->dev, "no reply to info request, serial unknown\n");
+	else if (result < 0)
 		goto reset;
 
-	if (optitrack_command(dev, cmd_stop_cam, bytes_written) < 0)
+	/* switch on all LEDs */
+	result = optitrack_set_led(dev, 0xF0, 0xF0);
+	if (result < 0)
 		goto reset;
 
-	cmd_set_led[1] = 0x00;
-	if (optitrack_command(dev, cmd_set_led, bytes_written) < 0)
+	result = optitrack_reset(dev, 0x00);
+	if (result < 0)
 		goto reset;
 
 	/* reset the device */
@@ -219,28 +593,153 @@ reset:
 	return result;
 }
 
+/* let the camera send frames */
+static int optitrack_start(struct usb_optitrack *dev)
+{
+	int result;
+
+	if (dev->streaming)
+		return 0;
+
+	result = optitrack_simple_command(dev, OPTITRACK_CMD_START);
+	if (result < 0)
+		return result;
+
+	dev->streaming = 1;
+	return 0;
+}
+
+static int optitrack_stop(struct usb_optitrack *dev)
+{
+	int result;
+
+	if (!dev->streaming)
+		return 0;
+
+	result = optitrack_simple_command(dev, OPTITRACK_CMD_STOP);
+	if (result < 0)
+		return result;
+
+	dev->streaming = 0;
+	return 0;
+}
+
+/* camera handshake, runs on optitrack_wq so probe doesn't block */
+static void optitrack_init_work(struct work_struct *work)
+{
+	struct usb_optitrack *dev =
+		container_of(work, struct usb_optitrack, init_work);
+	int result;
+
+	mutex_lock(&dev->lock);
+
+	result = optitrack_init(dev);
+	if (!result)
+		result = optitrack_start(dev);
+
+	mutex_unlock(&dev->lock);
+
+	if (result)
+		dev_err(&dev->interface->dev, "camera setup failed (error %d)\n", result);
+
+	/* be noisy */
+	dev_info(&dev->interface->dev,"%s (serial %d) now attached\n",DRIVER_DESC,dev->serial);
+
+	complete_all(&dev->ready);
+}
+
 static inline void optitrack_delete(struct usb_optitrack *dev)
 {
-	kfree(dev->bulk_in_buffer);
+	int i;
+
+	if (dev->urbs) {
+		for (i = 0; i < num_urbs; i++) {
+			if (!dev->urbs[i])
+				continue;
+			kfree(dev->urbs[i]->transfer_buffer);
+			usb_free_urb(dev->urbs[i]);
+		}
+		kfree(dev->urbs);
+	}
+
+	free_percpu(dev->stats);
+	vfree(dev->ring);
+	kfree(dev->runs);
+	kfree(dev->cmd_buffer);
 	kfree(dev);
 }
 
+/* allocate the frame ring and the bulk-in URBs feeding it */
+static int optitrack_alloc_ring(struct usb_optitrack *dev)
+{
+	unsigned char *buffer;
+	size_t header_size, slot_size, blob_offset;
+	int i;
+
+	/* the header gets its own page so the slots stay page aligned */
+	header_size = PAGE_ALIGN(sizeof(struct optitrack_ring));
+	blob_offset = ALIGN(sizeof(struct optitrack_frame) + dev->bulk_in_size, 8);
+	slot_size = blob_offset + OPTITRACK_MAX_BLOBS * sizeof(struct optitrack_blob);
+	dev->ring_size = PAGE_ALIGN(header_size + ring_depth * slot_size);
+
+	/* at most one run per record */
+	dev->runs = kmalloc(dev->bulk_in_size / OPTITRACK_RECORD_SIZE *
+		sizeof(struct optitrack_run), GFP_KERNEL);
+	if (!dev->runs)
+		return -ENOMEM;
+
+	/* zeroed and suitable for remap_vmalloc_range() */
+	dev->ring = vmalloc_user(dev->ring_size);
+	dev->urbs = kcalloc(num_urbs, sizeof(struct urb *), GFP_KERNEL);
+	if (!dev->ring || !dev->urbs)
+		return -ENOMEM;
+
+	dev->ring->version     = OPTITRACK_RING_VERSION;
+	dev->ring->header_size = header_size;
+	dev->ring->slot_count  = ring_depth;
+	dev->ring->slot_size   = slot_size;
+	dev->ring->blob_offset = blob_offset;
+	for (i = 0; i < ring_depth; i++)
+		optitrack_slot(dev, i)->sequence = OPTITRACK_SEQ_BUSY;
+
+	for (i = 0; i < num_urbs; i++) {
+		dev->urbs[i] = usb_alloc_urb(0, GFP_KERNEL);
+		if (!dev->urbs[i])
+			return -ENOMEM;
+
+		buffer = kmalloc(dev->bulk_in_size, GFP_KERNEL);
+		if (!buffer)
+			return -ENOMEM;
+
+		usb_fill_bulk_urb(dev->urbs[i], dev->udev,
+			usb_rcvbulkpipe(dev->udev, dev->bulk_in_endpointAddr),
+			buffer, dev->bulk_in_size, optitrack_bulk_cb, dev);
+	}
+
+	return 0;
+}
+
 static int optitrack_open(struct inode *inode, struct file *file)
 {
 	struct usb_optitrack *dev;
 	struct usb_interface *interface;
-	int result = 0;
+	struct optitrack_reader *reader;
 
 	/* get the interface from minor number and driver information */
 	interface = usb_find_interface (&optitrack_driver, iminor (inode));
 	if (!interface)
 		return -ENODEV;
 
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
 	mutex_lock(&open_disc_mutex);
 	/* get the device information block from the interface */
 	dev = usb_get_intfdata(interface);
 	if (!dev) {
 		mutex_unlock(&open_disc_mutex);
+		kfree(reader);
 		return -ENODEV;
 	}
 
@@ -248,46 +747,60 @@ static int optitrack_open(struct inode *inode, struct file *file)
 	mutex_lock(&dev->lock);
 	mutex_unlock(&open_disc_mutex);
 
-	/* check if already open */
-	if (dev->open) {
-		/* already open, so fail */
-		result = -EBUSY;
-	} else {
-		/* increment our usage count for the driver */
-		++dev->open;
-		/* save our object in the file's private structure */
-		file->private_data = dev;
-	} 
+	/* increment our usage count for the driver */
+	++dev->open;
+
+	mutex_init(&reader->lock);
+	reader->dev = dev;
+	reader->pid = task_tgid_vnr(current);
+	list_add_tail(&reader->list, &dev->readers);
+
+	/* save our reader in the file's private structure */
+	file->private_data = reader;
 
 	/* unlock this device */
 	mutex_unlock(&dev->lock);
-	return result;
+
+	/* don't hand out frames before the camera is set up */
+	if (wait_for_completion_interruptible(&dev->ready)) {
+		optitrack_release(inode, file);
+		return -ERESTARTSYS;
+	}
+
+	/* start with the next frame */
+	spin_lock_irq(&dev->ring_lock);
+	reader->cursor = dev->ring->head;
+	spin_unlock_irq(&dev->ring_lock);
+
+	return 0;
 }
 
 static int optitrack_release(struct inode *inode, struct file *file)
 {
+	struct optitrack_reader *reader = file->private_data;
 	struct usb_optitrack *dev;
 
-	dev = file->private_data;
-
-	if (dev == NULL)
+	if (reader == NULL)
 		return -ENODEV;
 
+	dev = reader->dev;
+
 	mutex_lock(&open_disc_mutex);
 	/* lock our device */
 	mutex_lock(&dev->lock);
 
-	/* are we really open? */
-	if (dev->open <= 0) {
-		mutex_unlock(&dev->lock);
-		mutex_unlock(&open_disc_mutex);
-		return -ENODEV;
-	}
+	list_del(&reader->list);
+	if (reader->mode == OPTITRACK_MODE_BLOBS)
+		dev->blob_readers--;
+	spin_lock_irq(&dev->ring_lock);
+	dev->closed_drops += reader->dropped;
+	spin_unlock_irq(&dev->ring_lock);
+	kfree(reader);
 
 	--dev->open;
 
-	if (!dev->present) {
-		/* the device was unplugged before the file was released */
+	if (!dev->present && !dev->open) {
+		/* the device was unplugged before the last file was released */
 		mutex_unlock(&dev->lock);
 		mutex_unlock(&open_disc_mutex);
 		optitrack_delete(dev);
@@ -298,26 +811,493 @@ static int optitrack_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/* check for frames this reader hasn't seen yet, without sleeping */
+static int optitrack_frame_ready(struct optitrack_reader *reader)
+{
+	struct usb_optitrack *dev = reader->dev;
+	unsigned long flags;
+	int result;
+
+	spin_lock_irqsave(&dev->ring_lock, flags);
+	result = (dev->ring->head != reader->cursor);
+	spin_unlock_irqrestore(&dev->ring_lock, flags);
+
+	return result;
+}
+
+/* skip frames that were overwritten before this reader got to them */
+static inline void optitrack_catch_up(struct optitrack_reader *reader)
+{
+	struct optitrack_ring *ring = reader->dev->ring;
+	unsigned int behind = ring->tail - reader->cursor;
+
+	if ((int)behind > 0) {
+		reader->cursor  += behind;
+		reader->dropped += behind;
+		reader->missed  += behind;
+	}
+}
+
+/* time from the completion handler until the frame was handed out */
+static inline void optitrack_count_read(struct usb_optitrack *dev, const struct optitrack_frame *header)
+{
+	s64 ns = ktime_to_ns(ktime_get()) - header->timestamp;
+	unsigned int bucket;
+
+	if (ns < 0)
+		ns = 0;
+
+	bucket = fls64(div_u64(ns, NSEC_PER_USEC));
+	if (bucket >= OPTITRACK_LATENCY_BUCKETS)
+		bucket = OPTITRACK_LATENCY_BUCKETS - 1;
+
+	this_cpu_inc(dev->stats->reads);
+	this_cpu_add(dev->stats->latency_sum, ns);
+	this_cpu_inc(dev->stats->latency[bucket]);
+}
+
+/* return the oldest unread frame with its header, truncated to count bytes */
 static ssize_t optitrack_read(struct file *file, char __user *buffer, size_t count,
 				loff_t * ppos)
 {
-	struct usb_optitrack *dev = file->private_data;
+	struct optitrack_reader *reader = file->private_data;
+	struct usb_optitrack *dev = reader->dev;
+	struct optitrack_frame header;
+	unsigned char *data;
+	unsigned int frame;
+	size_t length;
 	int result;
 
+	if (count < sizeof(header))
+		return -EINVAL;
+
+	/* lock this reader, other files don't have to wait for us */
+	mutex_lock(&reader->lock);
+
+	for (;;) {
+
+		/* verify that the device wasn't unplugged */
+		if (!dev->present) {
+			result = -ENODEV;
+			goto exit;
+		}
+
+		spin_lock_irq(&dev->ring_lock);
+
+		optitrack_catch_up(reader);
+
+		if (dev->ring->head == reader->cursor) {
+			spin_unlock_irq(&dev->ring_lock);
+			mutex_unlock(&reader->lock);
+
+			if (file->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+
+			/* sleep until the completion handler has a new frame */
+			if (wait_event_interruptible(dev->wait,
+					optitrack_frame_ready(reader) || !dev->present))
+				return -ERESTARTSYS;
+
+			mutex_lock(&reader->lock);
+			continue;
+		}
+
+		frame  = reader->cursor;
+		header = *optitrack_slot(dev, frame);
+		header.dropped += reader->missed;
+
+		if (reader->mode == OPTITRACK_MODE_BLOBS) {
+			data = (unsigned char *)optitrack_slot(dev, frame) + dev->ring->blob_offset;
+			header.length = header.blobs * sizeof(struct optitrack_blob);
+		} else {
+			data = (unsigned char *)(optitrack_slot(dev, frame) + 1);
+		}
+
+		length = min(count - sizeof(header), (size_t)header.length);
+		header.length = length;
+		spin_unlock_irq(&dev->ring_lock);
+
+		if (copy_to_user(buffer, &header, sizeof(header)) ||
+		    copy_to_user(buffer + sizeof(header), data, length)) {
+			result = -EFAULT;
+			goto exit;
+		}
+
+		/* the slot may have been overwritten while we were copying */
+		spin_lock_irq(&dev->ring_lock);
+		optitrack_catch_up(reader);
+		result = (reader->cursor == frame);
+		if (result) {
+			reader->cursor++;
+			reader->missed = 0;
+		}
+		spin_unlock_irq(&dev->ring_lock);
+
+		if (result)
+			break;
+	}
+
+	optitrack_count_read(dev, &header);
+	result = sizeof(header) + length;
+
+exit:
+	/* unlock the reader */
+	mutex_unlock(&reader->lock);
+	return result;
+}
+
+static long optitrack_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct optitrack_reader *reader = file->private_data;
+	struct usb_optitrack *dev = reader->dev;
+	void __user *argp = (void __user *)arg;
+	struct optitrack_info info;
+	struct optitrack_led led;
+	__u32 thresh, mode;
+	long result = 0;
+
 	/* lock this object */
 	mutex_lock(&dev->lock);
 
 	/* verify that the device wasn't unplugged */
 	if (!dev->present) {
-		mutex_unlock(&dev->lock);
-		return -ENODEV;
+		result = -ENODEV;
+		goto exit;
+	}
+
+	switch (cmd) {
+
+	case OPTITRACK_IOC_START:
+		result = optitrack_start(dev);
+		break;
+
+	case OPTITRACK_IOC_STOP:
+		result = optitrack_stop(dev);
+		break;
+
+	case OPTITRACK_IOC_SET_LED:
+		if (copy_from_user(&led, argp, sizeof(led))) {
+			result = -EFAULT;
+			break;
+		}
+		result = optitrack_set_led(dev, led.state, led.mask);
+		break;
+
+	case OPTITRACK_IOC_SET_THRESH:
+		if (get_user(thresh, (__u32 __user *)argp)) {
+			result = -EFAULT;
+			break;
+		}
+		if (thresh > 0xFFFF) {
+			result = -EINVAL;
+			break;
+		}
+		result = optitrack_set_thresh(dev, thresh);
+		break;
+
+	case OPTITRACK_IOC_GET_INFO:
+		result = optitrack_query_info(dev);
+		if (result < 0)
+			break;
+		memset(&info, 0, sizeof(info));
+		spin_lock_irq(&dev->ring_lock);
+		info.serial = dev->serial;
+		memcpy(info.reply, dev->info, OPTITRACK_INFO_SIZE);
+		spin_unlock_irq(&dev->ring_lock);
+		if (copy_to_user(argp, &info, sizeof(info)))
+			result = -EFAULT;
+		break;
+
+	case OPTITRACK_IOC_SET_MODE:
+		if (get_user(mode, (__u32 __user *)argp)) {
+			result = -EFAULT;
+			break;
+		}
+		if ((mode != OPTITRACK_MODE_RAW) && (mode != OPTITRACK_MODE_BLOBS)) {
+			result = -EINVAL;
+			break;
+		}
+		if (reader->mode == OPTITRACK_MODE_BLOBS)
+			dev->blob_readers--;
+		if (mode == OPTITRACK_MODE_BLOBS)
+			dev->blob_readers++;
+		reader->mode = mode;
+		break;
+
+	default:
+		result = -ENOTTY;
 	}
 
-	result = simple_read_from_buffer(buffer, count, ppos,
-					dev->bulk_in_buffer, dev->data_size );
+exit:
 	/* unlock the device */
 	mutex_unlock(&dev->lock);
-	return result;
+	return (result < 0) ? result : 0;
+}
+
+/* map the frame ring read-only into userspace */
+static int optitrack_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct optitrack_reader *reader = file->private_data;
+	struct usb_optitrack *dev = reader->dev;
+	unsigned long size = vma->vm_end - vma->vm_start;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EACCES;
+
+	if (vma->vm_pgoff || size > dev->ring_size)
+		return -EINVAL;
+
+	vm_flags_clear(vma, VM_MAYWRITE);
+
+	return remap_vmalloc_range(vma, dev->ring, 0);
+}
+
+static unsigned int optitrack_poll(struct file *file, poll_table *wait)
+{
+	struct optitrack_reader *reader = file->private_data;
+	struct usb_optitrack *dev = reader->dev;
+	unsigned int mask = 0;
+
+	poll_wait(file, &dev->wait, wait);
+
+	if (!dev->present)
+		return POLLIN | POLLRDNORM | POLLERR | POLLHUP;
+
+	if (optitrack_frame_ready(reader))
+		mask |= POLLIN | POLLRDNORM;
+
+	return mask;
+}
+
+/*
+  Statistics, in the sysfs directory of the USB interface
+  (/sys/class/usbmisc/optitrackN/device/):
+
+    frames, bytes        frames put into the ring and their camera data
+    empty, truncated     transfers without data, frames without end record
+    overruns             frames overwritten because the ring was full
+    reader_drops         frames readers missed because of that, all files added up
+    last_sequence        sequence number of the newest frame, -1 if none yet
+    serial               camera serial number, -1 if unknown
+    reads                frames returned by read()
+    resubmit_errors      URBs lost because they could not be resubmitted
+    errors/<status>      failed transfers: eproto, eilseq, etime, eoverflow,
+                         epipe and other
+
+  debugfs (optitrack/<interface>/) has the completion-to-read latency as
+  a histogram in "latency" and the open files with their drops in
+  "readers".
+*/
+
+/* add up one counter over all CPUs, offset is its place in struct optitrack_stats */
+static u64 optitrack_stat(struct usb_optitrack *dev, size_t offset)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *(u64 *)((unsigned char *)per_cpu_ptr(dev->stats, cpu) + offset);
+
+	return sum;
+}
+
+#define OPTITRACK_STAT(dev, field) \
+	optitrack_stat(dev, offsetof(struct optitrack_stats, field))
+
+static inline struct usb_optitrack *optitrack_from_device(struct device *d)
+{
+	return usb_get_intfdata(to_usb_interface(d));
+}
+
+#define OPTITRACK_STAT_ATTR(name, field) \
+static ssize_t optitrack_show_##name(struct device *d, \
+	struct device_attribute *attr, char *buf) \
+{ \
+	return sprintf(buf, "%llu\n", (unsigned long long) \
+		OPTITRACK_STAT(optitrack_from_device(d), field)); \
+} \
+static DEVICE_ATTR(name, S_IRUGO, optitrack_show_##name, NULL)
+
+OPTITRACK_STAT_ATTR(frames, frames);
+OPTITRACK_STAT_ATTR(bytes, bytes);
+OPTITRACK_STAT_ATTR(empty, empty);
+OPTITRACK_STAT_ATTR(truncated, truncated);
+OPTITRACK_STAT_ATTR(overruns, overruns);
+OPTITRACK_STAT_ATTR(reads, reads);
+OPTITRACK_STAT_ATTR(resubmit_errors, resubmit_errors);
+
+OPTITRACK_STAT_ATTR(eproto, errors[0]);
+OPTITRACK_STAT_ATTR(eilseq, errors[1]);
+OPTITRACK_STAT_ATTR(etime, errors[2]);
+OPTITRACK_STAT_ATTR(eoverflow, errors[3]);
+OPTITRACK_STAT_ATTR(epipe, errors[4]);
+OPTITRACK_STAT_ATTR(other, errors[5]);
+
+static ssize_t optitrack_show_reader_drops(struct device *d,
+	struct device_attribute *attr, char *buf)
+{
+	struct usb_optitrack *dev = optitrack_from_device(d);
+	struct optitrack_reader *reader;
+	u64 drops;
+
+	mutex_lock(&dev->lock);
+	spin_lock_irq(&dev->ring_lock);
+	drops = dev->closed_drops;
+	list_for_each_entry(reader, &dev->readers, list)
+		drops += reader->dropped;
+	spin_unlock_irq(&dev->ring_lock);
+	mutex_unlock(&dev->lock);
+
+	return sprintf(buf, "%llu\n", (unsigned long long)drops);
+}
+static DEVICE_ATTR(reader_drops, S_IRUGO, optitrack_show_reader_drops, NULL);
+
+static ssize_t optitrack_show_last_sequence(struct device *d,
+	struct device_attribute *attr, char *buf)
+{
+	struct usb_optitrack *dev = optitrack_from_device(d);
+
+	return sprintf(buf, "%d\n", (int)(dev->ring->head - 1));
+}
+static DEVICE_ATTR(last_sequence, S_IRUGO, optitrack_show_last_sequence, NULL);
+
+static ssize_t optitrack_show_serial(struct device *d,
+	struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", optitrack_from_device(d)->serial);
+}
+static DEVICE_ATTR(serial, S_IRUGO, optitrack_show_serial, NULL);
+
+static struct attribute *optitrack_stat_attrs[] = {
+	&dev_attr_frames.attr,
+	&dev_attr_bytes.attr,
+	&dev_attr_empty.attr,
+	&dev_attr_truncated.attr,
+	&dev_attr_overruns.attr,
+	&dev_attr_reader_drops.attr,
+	&dev_attr_last_sequence.attr,
+	&dev_attr_serial.attr,
+	&dev_attr_reads.attr,
+	&dev_attr_resubmit_errors.attr,
+	NULL
+};
+
+static struct attribute *optitrack_error_attrs[] = {
+	&dev_attr_eproto.attr,
+	&dev_attr_eilseq.attr,
+	&dev_attr_etime.attr,
+	&dev_attr_eoverflow.attr,
+	&dev_attr_epipe.attr,
+	&dev_attr_other.attr,
+	NULL
+};
+
+static const struct attribute_group optitrack_stat_group = {
+	.attrs = optitrack_stat_attrs,
+};
+
+static const struct attribute_group optitrack_error_group = {
+	.name = "errors",
+	.attrs = optitrack_error_attrs,
+};
+
+static const struct attribute_group *optitrack_groups[] = {
+	&optitrack_stat_group,
+	&optitrack_error_group,
+	NULL
+};
+
+/* completion-to-read latency histogram, with the mean */
+static int optitrack_latency_show(struct seq_file *m, void *v)
+{
+	struct usb_optitrack *dev = m->private;
+	u64 reads = OPTITRACK_STAT(dev, reads);
+	u64 count;
+	int i;
+
+	seq_printf(m, "reads %llu, mean %llu us\n", (unsigned long long)reads,
+		reads ? (unsigned long long)div64_u64(OPTITRACK_STAT(dev, latency_sum), reads * NSEC_PER_USEC) : 0ULL);
+
+	for (i = 0; i < OPTITRACK_LATENCY_BUCKETS; i++) {
+		count = OPTITRACK_STAT(dev, latency[i]);
+		if (i == 0)
+			seq_printf(m, "%8s - %7u us: %llu\n", "", 1, (unsigned long long)count);
+		else if (i == OPTITRACK_LATENCY_BUCKETS - 1)
+			seq_printf(m, "%8u -  %7s us: %llu\n", 1u << (i - 1), "", (unsigned long long)count);
+		else
+			seq_printf(m, "%8u - %7u us: %llu\n", 1u << (i - 1), 1u << i, (unsigned long long)count);
+	}
+
+	return 0;
+}
+
+/* open files: process, mode, frames behind the newest one and frames dropped */
+static int optitrack_readers_show(struct seq_file *m, void *v)
+{
+	struct usb_optitrack *dev = m->private;
+	struct optitrack_reader *reader;
+
+	seq_printf(m, "pid      mode  behind  dropped\n");
+
+	mutex_lock(&dev->lock);
+	spin_lock_irq(&dev->ring_lock);
+	list_for_each_entry(reader, &dev->readers, list)
+		seq_printf(m, "%-8d %-5s %6u %8u\n", reader->pid,
+			(reader->mode == OPTITRACK_MODE_BLOBS) ? "blobs" : "raw",
+			dev->ring->head - reader->cursor, reader->dropped);
+	spin_unlock_irq(&dev->ring_lock);
+	mutex_unlock(&dev->lock);
+
+	return 0;
+}
+
+static int optitrack_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, optitrack_latency_show, inode->i_private);
+}
+
+static int optitrack_readers_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, optitrack_readers_show, inode->i_private);
+}
+
+static const struct file_operations optitrack_latency_fops = {
+	.owner = THIS_MODULE,
+	.open = optitrack_latency_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static const struct file_operations optitrack_readers_fops = {
+	.owner = THIS_MODULE,
+	.open = optitrack_readers_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* statistics are a nice-to-have, failing to create them isn't fatal */
+static void optitrack_add_stats(struct usb_optitrack *dev)
+{
+	if (sysfs_create_groups(&dev->interface->dev.kobj, optitrack_groups))
+		dev_warn(&dev->interface->dev, "unable to create statistics in sysfs\n");
+
+	if (IS_ERR_OR_NULL(optitrack_debugfs))
+		return;
+
+	dev->debugfs = debugfs_create_dir(dev_name(&dev->interface->dev), optitrack_debugfs);
+	if (IS_ERR_OR_NULL(dev->debugfs))
+		return;
+
+	debugfs_create_file("latency", S_IRUGO, dev->debugfs, dev, &optitrack_latency_fops);
+	debugfs_create_file("readers", S_IRUGO, dev->debugfs, dev, &optitrack_readers_fops);
+}
+
+static void optitrack_remove_stats(struct usb_optitrack *dev)
+{
+	debugfs_remove_recursive(dev->debugfs);
+	sysfs_remove_groups(&dev->interface->dev.kobj, optitrack_groups);
 }
 
 static int optitrack_probe(struct usb_interface *interface,
@@ -340,6 +1320,14 @@ static int optitrack_probe(struct usb_interface *interface,
 		return -ENOMEM;
 
 	mutex_init(&dev->lock);
+	spin_lock_init(&dev->ring_lock);
+	init_waitqueue_head(&dev->wait);
+	INIT_LIST_HEAD(&dev->readers);
+	init_completion(&dev->ready);
+	init_completion(&dev->info_done);
+	INIT_WORK(&dev->init_work, optitrack_init_work);
+	INIT_WORK(&dev->halt_work, optitrack_halt_work);
+	init_usb_anchor(&dev->stalled);
 	dev->udev = udev;
 	dev->interface = interface;
 
@@ -357,14 +1345,6 @@ static int optitrack_probe(struct usb_interface *interface,
 		/* we found a bulk in endpoint */
 		dev->bulk_in_size = 4096; //le16_to_cpu(endpoint->wMaxPacketSize);
 		dev->bulk_in_endpointAddr = endpoint->bEndpointAddress;
-		dev->bulk_in_buffer =
-			kmalloc(dev->bulk_in_size, GFP_KERNEL);
-
-		if (!dev->bulk_in_buffer) {
-			err("Unable to allocate input buffer.");
-			optitrack_delete(dev);
-			return -ENOMEM;
-		}
 	}
 
 	if (!dev->bulk_in_endpointAddr || !dev->bulk_out_endpointAddr) {
@@ -376,6 +1356,14 @@ static int optitrack_probe(struct usb_interface *interface,
 	dev->bulk_in_endpointAddr = dev->bulk_in_endpointAddr & USB_ENDPOINT_NUMBER_MASK;
 	printk("input endpoint: 0x%hx, output endpoint: 0x%hx\n",dev->bulk_in_endpointAddr,dev->bulk_out_endpointAddr);
 
+	dev->cmd_buffer = kmalloc(CMD_BUFFER_SIZE, GFP_KERNEL);
+	dev->stats = alloc_percpu(struct optitrack_stats);
+	if (!dev->cmd_buffer || !dev->stats || optitrack_alloc_ring(dev)) {
+		err("Unable to allocate buffers.");
+		optitrack_delete(dev);
+		return -ENOMEM;
+	}
+
 	/* allow device read, write and ioctl */
 	dev->present = 1;
 
@@ -390,10 +1378,10 @@ static int optitrack_probe(struct usb_interface *interface,
 		return result;
 	}
 
-	optitrack_init(dev);
+	optitrack_add_stats(dev);
 
-	/* be noisy */
-	dev_info(&interface->dev,"%s (serial %d) now attached\n",DRIVER_DESC,dev->serial);
+	/* the handshake takes a while, don't hold up enumeration */
+	queue_work(optitrack_wq, &dev->init_work);
 
 	return 0;
 }
@@ -405,8 +1393,17 @@ static void optitrack_disconnect(struct usb_interface *interface)
 	/* get device structure */
 	dev = usb_get_intfdata(interface);
 
+	/* wait for the handshake, then release anybody waiting for it */
+	cancel_work_sync(&dev->init_work);
+	complete_all(&dev->ready);
+
+	/* no more completions after this point */
+	optitrack_kill_urbs(dev);
+	dev_info(&interface->dev, "%u frames received\n", dev->ring->head);
+
 	/* give back our minor */
 	usb_deregister_dev(interface, &optitrack_class);
+	optitrack_remove_stats(dev);
 
 	mutex_lock(&open_disc_mutex);
 	usb_set_intfdata(interface, NULL);
@@ -416,6 +1413,7 @@ static void optitrack_disconnect(struct usb_interface *interface)
 
 	/* prevent device read, write and ioctl */
 	dev->present = 0;
+	wake_up_interruptible(&dev->wait);
 
 	/* if the device is opened, optitrack_release will clean this up */
 	if (!dev->open) {
@@ -433,12 +1431,28 @@ static int __init usb_optitrack_init(void)
 {
 	int result;
 
+	if (ring_depth < 2)
+		ring_depth = 2;
+	if (num_urbs < 1)
+		num_urbs = 1;
+
 	info(DRIVER_DESC " " DRIVER_VERSION);
 
+	/* not single-threaded, so several cameras can be set up at once */
+	optitrack_wq = alloc_workqueue(DRIVER_SHORT, 0, 0);
+	if (!optitrack_wq)
+		return -ENOMEM;
+
+	/* NULL or an error without debugfs, the cameras then go without */
+	optitrack_debugfs = debugfs_create_dir(DRIVER_SHORT, NULL);
+
 	/* register this driver with the USB subsystem */
 	result = usb_register(&optitrack_driver);
-	if (result)
+	if (result) {
 		err("Unable to register device (error %d).", result);
+		debugfs_remove_recursive(optitrack_debugfs);
+		destroy_workqueue(optitrack_wq);
+	}
 
 	return result;
 }
@@ -447,6 +1461,8 @@ static void __exit usb_optitrack_exit(void)
 {
 	/* deregister this driver with the USB subsystem */
 	usb_deregister(&optitrack_driver);
+	debugfs_remove_recursive(optitrack_debugfs);
+	destroy_workqueue(optitrack_wq);
 }
 
 module_init(usb_optitrack_init);
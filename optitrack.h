@@ -0,0 +1,136 @@
+/* NaturalPoint Optitrack driver - userspace interface
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _OPTITRACK_H
+#define _OPTITRACK_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* length of the reply to the info command */
+#define OPTITRACK_INFO_SIZE 9
+
+struct optitrack_info {
+	__s32 serial;      /* serial number, negative if the camera didn't answer */
+	__u8  reply[12];   /* raw reply, OPTITRACK_INFO_SIZE bytes used */
+};
+
+struct optitrack_led {
+	__u8 state; /* new state of the LEDs selected by mask */
+	__u8 mask;  /* 0x10, 0x20, 0x40, 0x80 select LED 1 - 4 */
+};
+
+#define OPTITRACK_IOC_MAGIC 'O'
+
+#define OPTITRACK_IOC_START      _IO(OPTITRACK_IOC_MAGIC, 0)
+#define OPTITRACK_IOC_STOP       _IO(OPTITRACK_IOC_MAGIC, 1)
+#define OPTITRACK_IOC_SET_LED    _IOW(OPTITRACK_IOC_MAGIC, 2, struct optitrack_led)
+#define OPTITRACK_IOC_SET_THRESH _IOW(OPTITRACK_IOC_MAGIC, 3, __u32)
+#define OPTITRACK_IOC_GET_INFO   _IOR(OPTITRACK_IOC_MAGIC, 4, struct optitrack_info)
+#define OPTITRACK_IOC_SET_MODE   _IOW(OPTITRACK_IOC_MAGIC, 5, __u32)
+
+/* what read() returns after the frame header, selected per file */
+#define OPTITRACK_MODE_RAW   0 /* camera data as received */
+#define OPTITRACK_MODE_BLOBS 1 /* array of struct optitrack_blob */
+
+/* blobs reported per frame, larger ones are silently ignored */
+#define OPTITRACK_MAX_BLOBS 64
+
+/* connected group of scanlines, coordinates in sensor pixels */
+struct optitrack_blob {
+	__u32 area;   /* number of pixels */
+	__u32 cx, cy; /* centroid in 1/256 pixel */
+	__u16 x1, y1; /* bounding box, inclusive */
+	__u16 x2, y2; /* bounding box, exclusive */
+};
+
+/*
+  Every frame, whether it is returned by read() or found in the mapped
+  ring, starts with struct optitrack_frame followed by length bytes of
+  raw camera data. read() needs room for at least the header.
+
+  In OPTITRACK_MODE_BLOBS, read() returns the header followed by blobs
+  entries of struct optitrack_blob instead, and length is their size.
+*/
+
+struct optitrack_frame {
+	__u64 timestamp; /* CLOCK_MONOTONIC nanoseconds at URB completion */
+	__u32 sequence;  /* frame number, counting from 0 after probe */
+	__u32 length;    /* bytes of camera data following the header */
+	__u32 dropped;   /* frames lost since the previous one */
+	__u32 blobs;     /* blobs found, 0 unless some file is in blob mode */
+};
+
+/*
+  The frame ring can be mapped read-only with mmap() on /dev/optitrackN.
+  The mapping starts with struct optitrack_ring, followed by slot_count
+  frame slots of slot_size bytes each at offset header_size.
+
+  Frame n lives in slot n % slot_count. To read it in place:
+
+    1. frames tail .. head-1 are present, frames before tail are gone
+    2. check that the sequence in the slot's frame header is n, otherwise
+       the frame is being overwritten right now and has to be skipped
+    3. use the slot data (header plus length bytes)
+    4. check the sequence again - if it changed, the data was overwritten
+       while it was being used and must be discarded
+
+  The blobs of a frame are stored in the same slot, blob_offset bytes
+  after the start of the frame header.
+
+  head is only advanced after the slot has been completely written.
+  Use poll() or a blocking read() to wait for new frames.
+*/
+
+#define OPTITRACK_RING_VERSION 3
+
+/* sequence number of a slot that is currently being written */
+#define OPTITRACK_SEQ_BUSY 0xFFFFFFFF
+
+struct optitrack_ring {
+	__u32 version;     /* OPTITRACK_RING_VERSION */
+	__u32 header_size; /* offset of the first slot */
+	__u32 slot_count;  /* number of frame slots */
+	__u32 slot_size;   /* distance between two slots */
+	__u32 head;        /* number of frames written so far */
+	__u32 tail;        /* oldest frame still in the ring */
+	__u32 blob_offset; /* offset of the blob array inside a slot */
+	__u32 reserved;
+};
+
+#ifndef __KERNEL__
+
+/* header of frame n, or 0 if it isn't (or no longer) in the ring */
+static inline const struct optitrack_frame* optitrack_ring_frame(
+	const volatile struct optitrack_ring *ring, __u32 n)
+{
+	const volatile struct optitrack_frame *frame = (const volatile struct optitrack_frame*)
+		((const unsigned char*)ring + ring->header_size + (n % ring->slot_count) * ring->slot_size);
+
+	if ((__s32)(n - ring->tail) < 0 || (__s32)(ring->head - n) <= 0)
+		return 0;
+	if (frame->sequence != n)
+		return 0;
+	__sync_synchronize();
+
+	return (const struct optitrack_frame*)frame;
+}
+
+/* true if frame n was not overwritten while it was being used */
+static inline int optitrack_ring_valid(const struct optitrack_frame *frame, __u32 n)
+{
+	__sync_synchronize();
+	return ((const volatile struct optitrack_frame*)frame)->sequence == n;
+}
+
+#endif
+
+#endif
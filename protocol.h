@@ -0,0 +1,232 @@
+/* NaturalPoint Optitrack camera protocol
+
+  Command encoding and scanline record decoding, shared by the kernel
+  driver (C part only), the capture library and the viewer.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _OPTITRACK_PROTOCOL_H
+#define _OPTITRACK_PROTOCOL_H
+
+/* command opcodes, parameters follow the opcode byte */
+#define OPTITRACK_CMD_SET_LED    0x10 /* state, mask */
+#define OPTITRACK_CMD_START      0x12
+#define OPTITRACK_CMD_STOP       0x13
+#define OPTITRACK_CMD_RESET      0x14 /* 0x01 during setup, 0x00 before starting */
+#define OPTITRACK_CMD_SET_THRESH 0x15 /* threshold MSB, LSB */
+#define OPTITRACK_CMD_GET_INFO   0x17 /* camera replies with 9 bytes */
+
+/* longest command, and the length of each one including the opcode */
+#define OPTITRACK_CMD_MAX 3
+#define OPTITRACK_CMD_SIZE(op) \
+	((((op) == OPTITRACK_CMD_SET_LED) || ((op) == OPTITRACK_CMD_SET_THRESH)) ? 3 : \
+	 ((op) == OPTITRACK_CMD_RESET) ? 2 : 1)
+
+/*
+  A frame is a 2-byte header (byte count, OPTITRACK_FRAME_TAG) followed
+  by 4-byte records y, x1, x2, flags and terminated by an empty record.
+  Flags with any of the low 5 bits set mark fillers between USB packets
+  (7F 5F or FF BD, count, 1C). The top 3 bits extend y, x2 and x1.
+*/
+#define OPTITRACK_FRAME_TAG     0x1C
+#define OPTITRACK_RECORD_START  2
+#define OPTITRACK_RECORD_SIZE   4
+#define OPTITRACK_RECORD_FILLER 0x1F
+#define OPTITRACK_RECORD_MSB_Y  0x20
+#define OPTITRACK_RECORD_MSB_X2 0x40
+#define OPTITRACK_RECORD_MSB_X1 0x80
+
+/* sensor origin inside the raw coordinates, and the valid range after it */
+#define OPTITRACK_OFFSET_Y 11
+#define OPTITRACK_OFFSET_X 41
+#define OPTITRACK_MAX_Y    289
+#define OPTITRACK_MAX_X    356
+
+/* upper bound for the scanlines in one bulk transfer */
+#define OPTITRACK_MAX_LINES 1024
+
+/* results of optitrack_decode_record() */
+#define OPTITRACK_RECORD_END   0 /* empty record, end of frame */
+#define OPTITRACK_RECORD_SKIP  1 /* filler record */
+#define OPTITRACK_RECORD_RANGE 2 /* outside the sensor area */
+#define OPTITRACK_RECORD_LINE  3 /* valid scanline from x1 to x2 (exclusive) */
+
+/* write a command into buffer (at least OPTITRACK_CMD_MAX bytes), returns its length */
+static inline int optitrack_build_command(unsigned char *buffer, int opcode, int param1, int param2)
+{
+	buffer[0] = opcode;
+	buffer[1] = param1;
+	buffer[2] = param2;
+	return OPTITRACK_CMD_SIZE(opcode);
+}
+
+static inline int optitrack_is_frame(const unsigned char *data, int length)
+{
+	return (length >= OPTITRACK_RECORD_START) && (data[1] == OPTITRACK_FRAME_TAG);
+}
+
+/* decode one record into sensor coordinates */
+static inline int optitrack_decode_record(const unsigned char *record, int *y, int *x1, int *x2)
+{
+	int in = record[3];
+
+	*y  = record[0];
+	*x1 = record[1];
+	*x2 = record[2];
+
+	if (!*y && !*x1 && !*x2 && !in)
+		return OPTITRACK_RECORD_END;
+
+	if (in & OPTITRACK_RECORD_FILLER)
+		return OPTITRACK_RECORD_SKIP;
+
+	/* 255, not 256, as observed on the camera */
+	if (in & OPTITRACK_RECORD_MSB_Y)  *y  += 255;
+	if (in & OPTITRACK_RECORD_MSB_X2) *x2 += 255;
+	if (in & OPTITRACK_RECORD_MSB_X1) *x1 += 255;
+
+	*y  -= OPTITRACK_OFFSET_Y;
+	*x1 -= OPTITRACK_OFFSET_X;
+	*x2 -= OPTITRACK_OFFSET_X;
+
+	if ((*y  < 0) || (*x1 < 0) || (*x2 < 0) ||
+	    (*y  > OPTITRACK_MAX_Y) || (*x1 > OPTITRACK_MAX_X) || (*x2 > OPTITRACK_MAX_X))
+		return OPTITRACK_RECORD_RANGE;
+
+	return OPTITRACK_RECORD_LINE;
+}
+
+#ifdef __cplusplus
+
+// command ready to be sent, built at compile time where possible
+struct optitrack_command {
+	unsigned char data[OPTITRACK_CMD_MAX];
+	int size;
+};
+
+constexpr optitrack_command optitrack_make_command(int opcode, int param1 = 0, int param2 = 0) {
+	return { { (unsigned char)opcode, (unsigned char)param1, (unsigned char)param2 }, OPTITRACK_CMD_SIZE(opcode) };
+}
+
+constexpr optitrack_command optitrack_set_led(int state, int mask) { return optitrack_make_command(OPTITRACK_CMD_SET_LED,state,mask); }
+constexpr optitrack_command optitrack_set_thresh(int thresh)       { return optitrack_make_command(OPTITRACK_CMD_SET_THRESH,(thresh >> 8) & 0xFF,thresh & 0xFF); }
+constexpr optitrack_command optitrack_reset(int mode)              { return optitrack_make_command(OPTITRACK_CMD_RESET,mode); }
+constexpr optitrack_command optitrack_start()                      { return optitrack_make_command(OPTITRACK_CMD_START); }
+constexpr optitrack_command optitrack_stop()                       { return optitrack_make_command(OPTITRACK_CMD_STOP); }
+constexpr optitrack_command optitrack_get_info()                   { return optitrack_make_command(OPTITRACK_CMD_GET_INFO); }
+
+// one decoded scanline, pixels x1 .. x2-1 in row y
+struct optitrack_scanline {
+	short y, x1, x2;
+};
+
+// decoded scanlines of one frame, pointing into caller-provided storage
+struct optitrack_scanlines {
+	const optitrack_scanline* data;
+	int count;
+	int out_of_range; // records outside the sensor area
+
+	const optitrack_scanline* begin() const { return data; }
+	const optitrack_scanline* end()   const { return data + count; }
+};
+
+// decode all records of a frame into lines (room for max entries), never allocates
+static inline optitrack_scanlines optitrack_parse(const unsigned char* frame, int length, optitrack_scanline* lines, int max) {
+
+	optitrack_scanlines result = { lines, 0, 0 };
+	int y, x1, x2;
+
+	for (int i = OPTITRACK_RECORD_START; i + OPTITRACK_RECORD_SIZE <= length; i += OPTITRACK_RECORD_SIZE) {
+
+		int type = optitrack_decode_record(frame+i,&y,&x1,&x2);
+
+		if (type == OPTITRACK_RECORD_END) break;
+		if (type == OPTITRACK_RECORD_SKIP) continue;
+		if (type == OPTITRACK_RECORD_RANGE) { result.out_of_range++; continue; }
+		if (result.count == max) break;
+
+		optitrack_scanline& line = lines[result.count++];
+		line.y = y; line.x1 = x1; line.x2 = x2;
+	}
+
+	return result;
+}
+
+// length of the frame at the start of a raw stream including its end record,
+// max if there is no end record within max bytes, 0 if more data is needed
+static inline int optitrack_frame_length(const unsigned char* data, int size, int max) {
+	int y, x1, x2;
+	for (int i = OPTITRACK_RECORD_START; i + OPTITRACK_RECORD_SIZE <= size; i += OPTITRACK_RECORD_SIZE) {
+		if (optitrack_decode_record(data+i,&y,&x1,&x2) == OPTITRACK_RECORD_END) return i + OPTITRACK_RECORD_SIZE;
+		if (i + OPTITRACK_RECORD_SIZE >= max) return max;
+	}
+	return 0;
+}
+
+// inverse of optitrack_decode_record(), for synthetic frames
+static inline void optitrack_encode_record(unsigned char* record, int y, int x1, int x2) {
+
+	int in = 0;
+
+	y  += OPTITRACK_OFFSET_Y;
+	x1 += OPTITRACK_OFFSET_X;
+	x2 += OPTITRACK_OFFSET_X;
+
+	if (y  > 255) { y  -= 255; in |= OPTITRACK_RECORD_MSB_Y;  }
+	if (x2 > 255) { x2 -= 255; in |= OPTITRACK_RECORD_MSB_X2; }
+	if (x1 > 255) { x1 -= 255; in |= OPTITRACK_RECORD_MSB_X1; }
+
+	record[0] = y; record[1] = x1; record[2] = x2; record[3] = in;
+}
+
+// USB packet size, every packet starts with its byte count and the frame tag
+#define OPTITRACK_PACKET_SIZE 64
+
+// build a frame the way the camera sends it, including the filler records
+// between packets, returns its length or 0 if it doesn't fit into size bytes
+static inline int optitrack_encode(const optitrack_scanline* lines, int count, unsigned char* frame, int size) {
+
+	static const unsigned char pad[2][2] = { { 0x7F, 0x5F }, { 0xFF, 0xBD } };
+	int packet = 0, pos = OPTITRACK_RECORD_START, i = 0;
+
+	for (;;) {
+
+		// packet full: pad it and start the next one, which shows up as a filler record
+		if (pos - packet + OPTITRACK_RECORD_SIZE > OPTITRACK_PACKET_SIZE) {
+			if (pos + OPTITRACK_RECORD_SIZE > size) return 0;
+			frame[packet] = pos - packet;
+			frame[packet+1] = OPTITRACK_FRAME_TAG;
+			frame[pos] = pad[(packet / OPTITRACK_PACKET_SIZE) & 1][0];
+			frame[pos+1] = pad[(packet / OPTITRACK_PACKET_SIZE) & 1][1];
+			packet = pos + 2;
+			pos += OPTITRACK_RECORD_SIZE;
+		}
+
+		if (pos + OPTITRACK_RECORD_SIZE > size) return 0;
+
+		if (i == count) {
+			frame[pos] = frame[pos+1] = frame[pos+2] = frame[pos+3] = 0;
+			pos += OPTITRACK_RECORD_SIZE;
+			break;
+		}
+
+		optitrack_encode_record(frame+pos,lines[i].y,lines[i].x1,lines[i].x2);
+		pos += OPTITRACK_RECORD_SIZE;
+		i++;
+	}
+
+	frame[packet] = pos - packet;
+	frame[packet+1] = OPTITRACK_FRAME_TAG;
+	return pos;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,312 @@
+/* NaturalPoint Optitrack recording format
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <stdlib.h> // posix_memalign() etc.
+#include <string.h> // memcpy() etc.
+#include <time.h>   // clock_gettime()
+
+#include <unistd.h> // write()
+#include <fcntl.h>  // open()
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "record.h"
+
+// written in one go, a multiple of the O_DIRECT alignment
+#define RECORD_BUFFER (1 << 20)
+#define RECORD_ALIGN 4096
+
+static inline uint64_t padded(uint64_t size) { return (size + 7) & ~7ULL; }
+
+
+// writer
+
+struct recorder {
+
+	int fd;
+	int direct;
+
+	unsigned char* buffer;
+	size_t fill;
+	uint64_t offset; // of buffer[fill] in the file
+
+	uint64_t frames;
+	record_entry entries[RECORD_INDEX_INTERVAL];
+	unsigned int count;
+	std::vector<record_block_entry> blocks;
+
+	int failed;
+};
+
+// write out the whole buffer, or only its aligned part if not closing
+static void flush(recorder* rec, bool all) {
+
+	size_t size = rec->fill;
+	if (rec->direct && !all) size &= ~(size_t)(RECORD_ALIGN - 1);
+
+	// O_DIRECT can't write the unaligned end of the file
+	if (rec->direct && all && (size % RECORD_ALIGN)) {
+		fcntl(rec->fd,F_SETFL,fcntl(rec->fd,F_GETFL) & ~O_DIRECT);
+		rec->direct = 0;
+	}
+
+	for (size_t done = 0; done < size; ) {
+		ssize_t result = write(rec->fd,rec->buffer+done,size-done);
+		if (result <= 0) { rec->failed = 1; break; }
+		done += result;
+	}
+
+	memmove(rec->buffer,rec->buffer+size,rec->fill-size);
+	rec->fill -= size;
+}
+
+static void put(recorder* rec, const void* data, size_t size) {
+
+	while (size > 0) {
+		size_t chunk = std::min(size,RECORD_BUFFER - rec->fill);
+		memcpy(rec->buffer+rec->fill,data,chunk);
+		rec->fill += chunk; rec->offset += chunk;
+		data = (const unsigned char*)data + chunk; size -= chunk;
+		if (rec->fill == RECORD_BUFFER) flush(rec,false);
+	}
+}
+
+static void pad(recorder* rec) {
+	static const unsigned char zero[8] = { 0 };
+	put(rec,zero,padded(rec->offset) - rec->offset);
+}
+
+// index of the frames since the last block
+static void put_block(recorder* rec) {
+
+	if (rec->count == 0) return;
+
+	record_block block = { RECORD_BLOCK_MAGIC, rec->count, rec->frames - rec->count };
+	record_block_entry entry = { rec->offset, block.first, rec->entries[0].timestamp };
+
+	rec->blocks.push_back(entry);
+	put(rec,&block,sizeof(block));
+	put(rec,rec->entries,rec->count * sizeof(record_entry));
+	rec->count = 0;
+}
+
+struct recorder* record_create(const char* path, int direct) {
+
+	recorder* rec = new recorder();
+	struct timespec ts;
+
+	// not every file system supports O_DIRECT, fall back to buffered writes
+	rec->fd = direct ? open(path,O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT,0644) : -1;
+	rec->direct = (rec->fd >= 0);
+	if (rec->fd < 0) rec->fd = open(path,O_WRONLY | O_CREAT | O_TRUNC,0644);
+	if (rec->fd < 0) { delete rec; return 0; }
+
+	if (posix_memalign((void**)&rec->buffer,RECORD_ALIGN,RECORD_BUFFER)) {
+		close(rec->fd);
+		delete rec;
+		return 0;
+	}
+
+	clock_gettime(CLOCK_REALTIME,&ts);
+
+	record_header header;
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,RECORD_MAGIC,sizeof(header.magic));
+	header.byte_order = RECORD_BYTE_ORDER;
+	header.version = RECORD_VERSION;
+	header.interval = RECORD_INDEX_INTERVAL;
+	header.created = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	put(rec,&header,sizeof(header));
+
+	return rec;
+}
+
+int record_write(struct recorder* rec, int camera, const struct optitrack_frame* header, const unsigned char* data) {
+
+	record_frame frame;
+	memset(&frame,0,sizeof(frame));
+	frame.magic     = RECORD_FRAME_MAGIC;
+	frame.camera    = camera;
+	frame.timestamp = header->timestamp;
+	frame.sequence  = header->sequence;
+	frame.length    = header->length;
+	frame.dropped   = header->dropped;
+
+	rec->entries[rec->count].offset = rec->offset;
+	rec->entries[rec->count].timestamp = frame.timestamp;
+	rec->count++;
+	rec->frames++;
+
+	put(rec,&frame,sizeof(frame));
+	put(rec,data,frame.length);
+	pad(rec);
+
+	if (rec->count == RECORD_INDEX_INTERVAL) put_block(rec);
+
+	return rec->failed ? -1 : 0;
+}
+
+int record_close(struct recorder* rec) {
+
+	put_block(rec);
+
+	record_trailer trailer = { RECORD_TRAILER_MAGIC, (uint32_t)rec->blocks.size(), rec->offset, rec->frames };
+	put(rec,rec->blocks.data(),rec->blocks.size() * sizeof(record_block_entry));
+	put(rec,&trailer,sizeof(trailer));
+	flush(rec,true);
+
+	int result = (rec->failed || close(rec->fd)) ? -1 : 0;
+
+	free(rec->buffer);
+	delete rec;
+	return result;
+}
+
+
+// reader
+
+struct recording {
+
+	const unsigned char* data;
+	size_t size;
+
+	// from the trailer, or rebuilt if there is none
+	const record_block_entry* blocks;
+	uint32_t block_count;
+	uint64_t frames;
+	uint32_t interval;
+
+	std::vector<record_entry> entries; // only when rebuilt
+};
+
+// entries of block b
+static const record_entry* block_entries(recording* rec, uint32_t b, uint32_t* count) {
+	const record_block* block = (const record_block*)(rec->data + rec->blocks[b].offset);
+	*count = block->count;
+	return (const record_entry*)(block + 1);
+}
+
+static bool valid_trailer(recording* rec) {
+
+	if (rec->size < sizeof(record_header) + sizeof(record_trailer)) return false;
+
+	const record_trailer* trailer = (const record_trailer*)(rec->data + rec->size - sizeof(record_trailer));
+	if (trailer->magic != RECORD_TRAILER_MAGIC) return false;
+	if (trailer->footer + trailer->blocks * sizeof(record_block_entry) + sizeof(record_trailer) != rec->size) return false;
+
+	rec->blocks = (const record_block_entry*)(rec->data + trailer->footer);
+	rec->block_count = trailer->blocks;
+	rec->frames = trailer->frames;
+	return true;
+}
+
+// no trailer: walk through the frames, skipping index blocks
+static void rebuild(recording* rec) {
+
+	uint64_t offset = sizeof(record_header);
+
+	while (offset + sizeof(uint32_t) <= rec->size) {
+
+		uint32_t magic = *(const uint32_t*)(rec->data + offset);
+
+		if (magic == RECORD_FRAME_MAGIC && offset + sizeof(record_frame) <= rec->size) {
+			const record_frame* frame = (const record_frame*)(rec->data + offset);
+			uint64_t next = offset + padded(sizeof(record_frame) + frame->length);
+			if (next > rec->size) break; // cut off in the middle
+			rec->entries.push_back({ offset, frame->timestamp });
+			offset = next;
+		} else if (magic == RECORD_BLOCK_MAGIC && offset + sizeof(record_block) <= rec->size) {
+			const record_block* block = (const record_block*)(rec->data + offset);
+			offset += sizeof(record_block) + block->count * sizeof(record_entry);
+		} else break;
+	}
+
+	rec->frames = rec->entries.size();
+	rec->block_count = 0;
+}
+
+struct recording* recording_open(const char* path) {
+
+	struct stat st;
+	int fd = open(path,O_RDONLY);
+	if (fd < 0) return 0;
+
+	if (fstat(fd,&st) || (size_t)st.st_size < sizeof(record_header)) { close(fd); return 0; }
+
+	void* data = mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if (data == MAP_FAILED) return 0;
+
+	recording* rec = new recording();
+	rec->data = (const unsigned char*)data;
+	rec->size = st.st_size;
+
+	const record_header* header = (const record_header*)rec->data;
+	if (memcmp(header->magic,RECORD_MAGIC,sizeof(header->magic)) || (header->byte_order != RECORD_BYTE_ORDER) ||
+	    (header->version != RECORD_VERSION) || !header->interval) {
+		recording_close(rec);
+		return 0;
+	}
+	rec->interval = header->interval;
+
+	if (!valid_trailer(rec)) rebuild(rec);
+
+	// frames are read in order
+	madvise((void*)rec->data,rec->size,MADV_SEQUENTIAL);
+
+	return rec;
+}
+
+uint64_t recording_count(struct recording* rec) {
+	return rec->frames;
+}
+
+const struct record_frame* recording_frame(struct recording* rec, uint64_t n) {
+
+	uint64_t offset;
+
+	if (n >= rec->frames) return 0;
+
+	if (rec->block_count) {
+		// every block but the last one holds exactly interval frames
+		uint32_t count;
+		const record_entry* entries = block_entries(rec,n / rec->interval,&count);
+		offset = entries[n % rec->interval].offset;
+	} else
+		offset = rec->entries[n].offset;
+
+	return (const record_frame*)(rec->data + offset);
+}
+
+uint64_t recording_seek(struct recording* rec, uint64_t t) {
+
+	auto before = [](const record_entry& e, uint64_t t) { return e.timestamp < t; };
+
+	if (!rec->block_count)
+		return std::lower_bound(rec->entries.begin(),rec->entries.end(),t,before) - rec->entries.begin();
+
+	// last block starting at or before t, then the frame inside it
+	const record_block_entry* block = std::upper_bound(rec->blocks,rec->blocks + rec->block_count,t,
+		[](uint64_t t, const record_block_entry& b) { return t < b.timestamp; });
+	if (block != rec->blocks) block--;
+
+	uint32_t count;
+	const record_entry* entries = block_entries(rec,block - rec->blocks,&count);
+	return block->first + (std::lower_bound(entries,entries + count,t,before) - entries);
+}
+
+void recording_close(struct recording* rec) {
+	munmap((void*)rec->data,rec->size);
+	delete rec;
+}
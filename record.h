@@ -0,0 +1,124 @@
+/* NaturalPoint Optitrack recording format
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _RECORD_H
+#define _RECORD_H
+
+#include <stdint.h>
+
+#include "optitrack.h"
+
+/*
+  A recording is a struct record_header followed by frames, each a
+  struct record_frame and length bytes of camera data padded to 8 bytes.
+  After every RECORD_INDEX_INTERVAL frames comes an index block, a struct
+  record_block and one struct record_entry per frame since the previous
+  block. When the file is closed properly, the last (partial) index block
+  is followed by the footer, a struct record_block_entry for every index
+  block, and finally a struct record_trailer at the very end.
+
+  Frames are stored in the order they were written, timestamps are
+  expected to increase in that order. All fields are in the byte order
+  of the host that wrote them, so the reader can use the mapped structs
+  as they are; RECORD_BYTE_ORDER in the header tells it whether it can.
+  A recording without a trailer (the writer didn't finish) can still be
+  read, the index is then rebuilt by walking through the frames.
+*/
+
+#define RECORD_MAGIC   "OPTIREC"
+#define RECORD_VERSION 1
+
+#define RECORD_FRAME_MAGIC   0x4D524652 // "RFRM"
+#define RECORD_BLOCK_MAGIC   0x58444952 // "RIDX"
+#define RECORD_TRAILER_MAGIC 0x444E4552 // "REND"
+
+#define RECORD_INDEX_INTERVAL 1024
+
+// reads back as 0x04030201 on a host with the other byte order
+#define RECORD_BYTE_ORDER 0x01020304
+
+struct record_header {
+	char magic[8];       // RECORD_MAGIC
+	uint32_t byte_order; // RECORD_BYTE_ORDER
+	uint32_t version;    // RECORD_VERSION
+	uint32_t interval;   // frames per index block
+	uint32_t reserved;
+	uint64_t created;    // CLOCK_REALTIME nanoseconds
+};
+
+struct record_frame {
+	uint32_t magic;     // RECORD_FRAME_MAGIC
+	uint16_t camera;    // chosen by the writer, e.g. the minor number
+	uint16_t reserved;
+	uint64_t timestamp; // as in struct optitrack_frame
+	uint32_t sequence;
+	uint32_t length;    // bytes of camera data following
+	uint32_t dropped;
+	uint32_t padding;
+};
+
+struct record_block {
+	uint32_t magic;     // RECORD_BLOCK_MAGIC
+	uint32_t count;     // entries following
+	uint64_t first;     // number of the first frame listed
+};
+
+struct record_entry {
+	uint64_t offset;    // of the struct record_frame
+	uint64_t timestamp;
+};
+
+struct record_block_entry {
+	uint64_t offset;    // of the struct record_block
+	uint64_t first;
+	uint64_t timestamp; // of the first frame listed
+};
+
+struct record_trailer {
+	uint32_t magic;     // RECORD_TRAILER_MAGIC
+	uint32_t blocks;
+	uint64_t footer;    // offset of the first struct record_block_entry
+	uint64_t frames;
+};
+
+
+// writer
+
+struct recorder;
+
+// start a new recording, direct = 1 bypasses the page cache with O_DIRECT
+struct recorder* record_create(const char* path, int direct);
+
+// append a frame, 0 on success, -1 if writing failed
+int record_write(struct recorder* rec, int camera, const struct optitrack_frame* header, const unsigned char* data);
+
+// write the remaining index and the footer, 0 on success
+int record_close(struct recorder* rec);
+
+
+// reader
+
+struct recording;
+
+// map a recording, 0 if it can't be opened, isn't one or comes from a host with the other byte order
+struct recording* recording_open(const char* path);
+
+uint64_t recording_count(struct recording* rec);
+
+// frame n, its data follows the header, 0 if n is out of range
+const struct record_frame* recording_frame(struct recording* rec, uint64_t n);
+
+// number of the first frame with a timestamp >= t, recording_count() if there is none
+uint64_t recording_seek(struct recording* rec, uint64_t t);
+
+void recording_close(struct recording* rec);
+
+#endif
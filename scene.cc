@@ -0,0 +1,130 @@
+/* NaturalPoint Optitrack synthetic multi-camera scene
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <math.h> // sqrt() etc.
+
+#include <algorithm>
+
+#include "scene.h"
+
+#define RING_RADIUS 3000.0
+#define RING_HEIGHT 2000.0
+#define CUBE_SIZE   2000.0
+#define FOCAL       310.0 // pixels, 357 across gives about 60 degrees
+
+// uniform in 0 .. 1, the same sequence for the same seed everywhere
+static double uniform(scene* s) {
+	s->seed = s->seed * 1664525 + 1013904223;
+	return (s->seed >> 8) / 16777216.0;
+}
+
+// roughly normal, mean 0 and standard deviation 1
+static double normal(scene* s) {
+	double sum = 0;
+	for (int i = 0; i < 12; i++) sum += uniform(s);
+	return sum - 6;
+}
+
+// P = K [R | -R*C] for a camera at C looking at T, sensor rows going down
+static void look_at(triangulate_camera* camera, const double* C, const double* T) {
+
+	double f[3], r[3], d[3], up[3] = { 0, 0, 1 };
+
+	for (int i = 0; i < 3; i++) f[i] = T[i] - C[i];
+	double n = sqrt(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+	for (int i = 0; i < 3; i++) f[i] /= n;
+
+	// right = forward x up, down = forward x right
+	r[0] = f[1]*up[2] - f[2]*up[1]; r[1] = f[2]*up[0] - f[0]*up[2]; r[2] = f[0]*up[1] - f[1]*up[0];
+	n = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+	for (int i = 0; i < 3; i++) r[i] /= n;
+	d[0] = f[1]*r[2] - f[2]*r[1]; d[1] = f[2]*r[0] - f[0]*r[2]; d[2] = f[0]*r[1] - f[1]*r[0];
+
+	const double* R[3] = { r, d, f };
+	double K[3][3] = { { FOCAL, 0, OPTITRACK_MAX_X / 2.0 }, { 0, FOCAL, OPTITRACK_MAX_Y / 2.0 }, { 0, 0, 1 } };
+
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 4; col++) {
+			double sum = 0;
+			for (int k = 0; k < 3; k++) {
+				double rt = (col < 3) ? R[k][col] : -(R[k][0]*C[0] + R[k][1]*C[1] + R[k][2]*C[2]);
+				sum += K[row][k] * rt;
+			}
+			camera->P[row*4+col] = sum;
+		}
+	}
+}
+
+void scene_create(scene* s, int cameras, int markers, unsigned int seed) {
+
+	s->cameras = std::min(cameras,TRIANGULATE_MAX_CAMERAS);
+	s->markers = std::min(markers,SCENE_MAX_MARKERS);
+	s->noise = 0.1;
+	s->occlusion = 0.05;
+	s->frame = 0;
+	s->seed = seed;
+
+	const double center[3] = { 0, 0, CUBE_SIZE / 2 };
+
+	for (int i = 0; i < s->cameras; i++) {
+		double angle = 2 * M_PI * i / s->cameras;
+		double C[3] = { RING_RADIUS * cos(angle), RING_RADIUS * sin(angle), RING_HEIGHT };
+		look_at(&s->camera[i],C,center);
+	}
+
+	// up to 20 mm per frame in each direction
+	for (int m = 0; m < s->markers; m++)
+		for (int i = 0; i < 3; i++) {
+			s->position[m][i] = (uniform(s) - 0.5) * CUBE_SIZE + center[i];
+			s->velocity[m][i] = (uniform(s) - 0.5) * 40;
+		}
+}
+
+void scene_step(scene* s, triangulate_set* set, float truth[][3]) {
+
+	const double center[3] = { 0, 0, CUBE_SIZE / 2 };
+
+	for (int m = 0; m < s->markers; m++)
+		for (int i = 0; i < 3; i++) {
+			s->position[m][i] += s->velocity[m][i];
+			if (fabs(s->position[m][i] - center[i]) > CUBE_SIZE / 2) s->velocity[m][i] = -s->velocity[m][i];
+			if (truth) truth[m][i] = s->position[m][i];
+		}
+
+	set->timestamp = s->frame++ * 10000000ULL; // 100 fps
+
+	for (int k = 0; k < s->cameras; k++) {
+
+		triangulate_view& view = set->views[k];
+		view.count = 0;
+
+		for (int m = 0; m < s->markers; m++) {
+			float x, y;
+			if (uniform(s) < s->occlusion) continue;
+			if (!triangulate_project(&s->camera[k],s->position[m],&x,&y)) continue;
+			x += normal(s) * s->noise;
+			y += normal(s) * s->noise;
+			if (x < 0 || y < 0 || x > OPTITRACK_MAX_X || y > OPTITRACK_MAX_Y) continue;
+			view.x[view.count] = x;
+			view.y[view.count] = y;
+			view.count++;
+		}
+
+		// the camera reports blobs top to bottom, not in marker order
+		int order[OPTITRACK_MAX_BLOBS];
+		float x[OPTITRACK_MAX_BLOBS], y[OPTITRACK_MAX_BLOBS];
+		for (int i = 0; i < view.count; i++) { order[i] = i; x[i] = view.x[i]; y[i] = view.y[i]; }
+		std::sort(order,order+view.count,[&](int a, int b) { return y[a] < y[b]; });
+		for (int i = 0; i < view.count; i++) { view.x[i] = x[order[i]]; view.y[i] = y[order[i]]; }
+	}
+
+	for (int k = s->cameras; k < TRIANGULATE_MAX_CAMERAS; k++) set->views[k].count = 0;
+}
@@ -0,0 +1,46 @@
+/* NaturalPoint Optitrack synthetic multi-camera scene
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _SCENE_H
+#define _SCENE_H
+
+#include "triangulate.h"
+
+#define SCENE_MAX_MARKERS TRIANGULATE_MAX_POINTS
+
+/*
+  Cameras on a ring of 3 m radius, 2 m up, all looking at the center of
+  a 2 m cube standing on the floor, with a horizontal field of view of
+  about 60 degrees. Markers fly through the cube in straight lines and
+  bounce off its walls. Units are millimeters, time steps are frames.
+  The same seed always gives the same scene.
+*/
+struct scene {
+	int cameras;
+	struct triangulate_camera camera[TRIANGULATE_MAX_CAMERAS];
+
+	int markers;
+	float position[SCENE_MAX_MARKERS][3];
+	float velocity[SCENE_MAX_MARKERS][3];
+
+	float noise;     // standard deviation of the blob centers, in pixels
+	float occlusion; // chance of a marker being hidden from a camera in a frame
+	uint64_t frame;
+	uint32_t seed;
+};
+
+void scene_create(struct scene* s, int cameras, int markers, unsigned int seed);
+
+// advance all markers by one frame and fill set with what each camera sees,
+// in row order like the camera sends them; truth (if given) gets the positions
+void scene_step(struct scene* s, struct triangulate_set* set, float truth[][3]);
+
+#endif
@@ -0,0 +1,335 @@
+/* NaturalPoint Optitrack multi-camera frame synchronizer
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <math.h> // fabs()
+
+#include <atomic>
+
+#include "sync.h"
+
+// least-squares gains for the first frames, then these (critically damped)
+#define ALPHA 0.005
+#define BETA  (ALPHA * ALPHA / (2 - ALPHA))
+
+// frames before a jump in the timestamps restarts the filter
+#define WARMUP 16
+
+// how fast the reported offsets follow, per set
+#define OFFSET_GAIN 0.02
+
+// fraction of a period another gap has to be larger to take over
+#define HYSTERESIS 0.05
+
+// until some camera knows its period: 100 fps
+#define DEFAULT_PERIOD 10000000.0
+
+// queued frame, the capture thread fills in everything up to time
+struct entry {
+	uint64_t timestamp;
+	uint32_t sequence;
+	uint32_t dropped;
+	triangulate_view view;
+	double time; // filtered, relative to sync->origin, set by the consumer
+};
+
+/*
+  Single producer, single consumer ring: the capture thread only writes
+  head, the consumer only writes tail, each on its own cache line.
+*/
+struct channel {
+
+	alignas(64) std::atomic<uint32_t> head;
+	std::atomic<uint64_t> overflow;
+
+	alignas(64) std::atomic<uint32_t> tail;
+	uint32_t seen; // entries already run through the filter, only those are used
+
+	entry* ring;
+
+	// alpha-beta filter over the frame count, consumer only
+	uint64_t frames; // updates since the last restart
+	double phase, period;
+	double jitter, offset;
+};
+
+struct synchronizer {
+
+	int cameras;
+	double latency;
+	int min_cameras;
+
+	channel channels[TRIANGULATE_MAX_CAMERAS];
+
+	// times are kept as doubles relative to the first timestamp seen
+	bool started;
+	uint64_t origin;
+
+	// current cut between sets: the camera after the largest gap, the
+	// average period, the phase of that camera and the width of a set
+	int first;
+	double period, start, width;
+
+	bool emitted;
+	double boundary; // end of the last set
+
+	sync_stats stats;
+};
+
+synchronizer* sync_create(int cameras, uint64_t latency, int min_cameras) {
+
+	if (cameras < 1 || cameras > TRIANGULATE_MAX_CAMERAS) return 0;
+
+	synchronizer* sync = new synchronizer();
+
+	sync->cameras = cameras;
+	sync->latency = latency;
+	sync->min_cameras = min_cameras;
+	sync->first = -1;
+	sync->period = DEFAULT_PERIOD;
+
+	for (int k = 0; k < cameras; k++)
+		sync->channels[k].ring = new entry[SYNC_QUEUE_SIZE];
+
+	return sync;
+}
+
+void sync_destroy(synchronizer* sync) {
+	for (int k = 0; k < sync->cameras; k++) delete[] sync->channels[k].ring;
+	delete sync;
+}
+
+int sync_push(synchronizer* sync, int camera, const optitrack_frame* header, const optitrack_centroid* centroids, int count) {
+
+	channel& c = sync->channels[camera];
+	uint32_t head = c.head.load(std::memory_order_relaxed);
+
+	if (head - c.tail.load(std::memory_order_acquire) >= SYNC_QUEUE_SIZE) {
+		c.overflow.fetch_add(1,std::memory_order_relaxed);
+		return -1;
+	}
+
+	entry& e = c.ring[head % SYNC_QUEUE_SIZE];
+	e.timestamp = header->timestamp;
+	e.sequence  = header->sequence;
+	e.dropped   = header->dropped;
+	triangulate_view_set(&e.view,centroids,(count < OPTITRACK_MAX_BLOBS) ? count : OPTITRACK_MAX_BLOBS);
+
+	c.head.store(head + 1,std::memory_order_release);
+	return 0;
+}
+
+/*
+  With k updates since the (re)start, the gains 2(2k-1)/(k(k+1)) and
+  6/(k(k+1)) make the filter an exact least-squares line fit, so it
+  settles within a few frames; later on the fixed gains take over.
+*/
+static double filter(synchronizer* sync, channel& c, const entry& e) {
+
+	double t = (double)(int64_t)(e.timestamp - sync->origin);
+
+	if (c.frames == 0) {
+		c.phase = t;
+		c.frames = 1;
+		return t;
+	}
+
+	uint64_t steps = 1 + e.dropped;
+	double predicted = c.phase + c.period * steps;
+	double r = t - predicted;
+
+	// camera restarted or stalled: start over, but keep the period
+	if (c.frames >= WARMUP && fabs(r) > c.period / 2) {
+		sync->stats.resync++;
+		c.phase = t;
+		c.frames = 1;
+		return t;
+	}
+
+	c.frames++;
+
+	double k = c.frames;
+	double alpha = 2 * (2*k - 1) / (k * (k + 1)), beta = 6 / (k * (k + 1));
+	if (alpha < ALPHA) alpha = ALPHA;
+	if (beta < BETA) beta = BETA;
+
+	c.phase = predicted + alpha * r;
+	c.period += beta * r / steps;
+	c.jitter += ((k > 2 ? fabs(r) : 0) - c.jitter) * ALPHA;
+
+	return c.phase;
+}
+
+// next filtered frame of camera k and its time, or 0
+static const entry* peek(synchronizer* sync, int k, double* time) {
+
+	channel& c = sync->channels[k];
+	uint32_t tail = c.tail.load(std::memory_order_relaxed);
+
+	if (tail == c.seen) return 0;
+
+	const entry& e = c.ring[tail % SYNC_QUEUE_SIZE];
+	*time = e.time;
+	return &e;
+}
+
+static void pop(synchronizer* sync, int k) {
+	channel& c = sync->channels[k];
+	c.tail.store(c.tail.load(std::memory_order_relaxed) + 1,std::memory_order_release);
+}
+
+/*
+  Sets are cut in the middle of the largest gap between the exposure
+  phases of the cameras, so the frames of one set are as close together
+  as they can be. The gap only moves on to another pair of cameras once
+  that gap is clearly larger, otherwise two nearly equal gaps would make
+  cameras jump back and forth between neighbouring sets.
+*/
+static void grid(synchronizer* sync) {
+
+	double period = 0, phase[TRIANGULATE_MAX_CAMERAS], gap[TRIANGULATE_MAX_CAMERAS];
+	int known = 0, ref = -1, best = -1;
+
+	for (int k = 0; k < sync->cameras; k++)
+		if (sync->channels[k].frames > 1) { period += sync->channels[k].period; known++; if (ref < 0) ref = k; }
+
+	if (!known) return;
+	period /= known;
+
+	for (int k = 0; k < sync->cameras; k++) {
+		if (sync->channels[k].frames < 2) continue;
+		phase[k] = fmod(sync->channels[k].phase - sync->channels[ref].phase,period);
+		if (phase[k] < 0) phase[k] += period;
+	}
+
+	// gap in front of every camera, to the previous phase around the circle
+	for (int k = 0; k < sync->cameras; k++) {
+		if (sync->channels[k].frames < 2) continue;
+		gap[k] = period;
+		for (int j = 0; j < sync->cameras; j++) {
+			if (j == k || sync->channels[j].frames < 2) continue;
+			double d = phase[k] - phase[j];
+			if (d <= 0) d += period;
+			if (d < gap[k]) gap[k] = d;
+		}
+		if (best < 0 || gap[k] > gap[best]) best = k;
+	}
+
+	int first = sync->first;
+	if (first >= 0 && sync->channels[first].frames > 1 && gap[first] + period * HYSTERESIS >= gap[best]) best = first;
+
+	sync->first  = best;
+	sync->period = period;
+	sync->start  = sync->channels[best].phase;
+	sync->width  = period - gap[best];
+}
+
+int sync_poll(synchronizer* sync, uint64_t now, sync_set* out) {
+
+	// filter everything that came in since the last call
+	for (int k = 0; k < sync->cameras; k++) {
+
+		channel& c = sync->channels[k];
+		uint32_t head = c.head.load(std::memory_order_acquire);
+
+		for (; c.seen != head; c.seen++) {
+			entry& e = c.ring[c.seen % SYNC_QUEUE_SIZE];
+			if (!sync->started) { sync->origin = e.timestamp; sync->started = true; }
+			e.time = filter(sync,c,e);
+		}
+	}
+
+	grid(sync);
+
+	for (;;) {
+
+		double time[TRIANGULATE_MAX_CAMERAS];
+		const entry* next[TRIANGULATE_MAX_CAMERAS];
+		int anchor = -1;
+
+		// throw away what belongs to sets already delivered
+		for (int k = 0; k < sync->cameras; k++) {
+			while ((next[k] = peek(sync,k,&time[k])) && sync->emitted && (time[k] < sync->boundary)) {
+				sync->stats.late++;
+				pop(sync,k);
+			}
+			if (next[k] && (anchor < 0 || time[k] < time[anchor])) anchor = k;
+		}
+
+		if (anchor < 0) return 0;
+
+		// the set the oldest frame belongs to, it ends half a period after its center
+		double slot = floor((time[anchor] - sync->start + (sync->period - sync->width) / 2) / sync->period);
+		double center = sync->start + sync->width / 2 + slot * sync->period;
+		double end = center + sync->period / 2;
+
+		uint32_t present = 0;
+		bool waiting = false;
+
+		for (int k = 0; k < sync->cameras; k++) {
+			if (!next[k]) waiting = true;
+			else if (time[k] < end) present |= 1 << k;
+		}
+
+		// a camera has nothing queued yet, it may still deliver this set
+		if (waiting && ((double)(int64_t)(now - sync->origin) < center + sync->latency)) return 0;
+
+		int count = 0;
+		for (int k = 0; k < TRIANGULATE_MAX_CAMERAS; k++) out->set.views[k].count = 0;
+		out->set.timestamp = sync->origin + (int64_t)center;
+		out->present = present;
+
+		for (int k = 0; k < sync->cameras; k++) {
+
+			out->sequence[k] = 0;
+			out->timestamp[k] = 0;
+			if (!(present & (1 << k))) continue;
+
+			channel& c = sync->channels[k];
+			out->set.views[k] = next[k]->view;
+			out->sequence[k] = next[k]->sequence;
+			out->timestamp[k] = sync->origin + (int64_t)time[k];
+			c.offset += (time[k] - center - c.offset) * OFFSET_GAIN;
+			count++;
+			pop(sync,k);
+		}
+
+		sync->emitted = true;
+		sync->boundary = end;
+
+		if (count < sync->min_cameras) { sync->stats.dropped++; continue; }
+
+		sync->stats.sets++;
+		if (count < sync->cameras) sync->stats.partial++;
+		return 1;
+	}
+}
+
+void sync_get_clock(synchronizer* sync, int camera, sync_clock* out) {
+
+	double mean = 0;
+	int known = 0;
+
+	for (int k = 0; k < sync->cameras; k++)
+		if (sync->channels[k].frames > 1) { mean += sync->channels[k].period; known++; }
+
+	const channel& c = sync->channels[camera];
+	out->period = c.period;
+	out->drift  = (known && c.frames > 1) ? (c.period / (mean / known) - 1) * 1e6 : 0;
+	out->offset = c.offset;
+	out->jitter = c.jitter;
+}
+
+void sync_get_stats(synchronizer* sync, sync_stats* out) {
+	*out = sync->stats;
+	out->overflow = 0;
+	for (int k = 0; k < sync->cameras; k++)
+		out->overflow += sync->channels[k].overflow.load(std::memory_order_relaxed);
+}
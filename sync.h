@@ -0,0 +1,82 @@
+/* NaturalPoint Optitrack multi-camera frame synchronizer
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _SYNC_H
+#define _SYNC_H
+
+#include <stdint.h>
+
+#include "optitrack.h"
+#include "centroid.h"
+#include "triangulate.h"
+
+// frames buffered per camera between sync_push() and sync_poll()
+#define SYNC_QUEUE_SIZE 64
+
+/*
+  Every camera free-runs at its own rate, and its driver timestamps
+  (CLOCK_MONOTONIC at URB completion) add a few hundred microseconds of
+  USB jitter. For every camera an alpha-beta filter over the frame count
+  (sequence plus dropped frames) tracks the exposure times, which removes
+  the jitter and yields the camera's period and phase, i.e. its clock
+  drift and offset against the others.
+
+  Sets are cut in the middle of the largest gap between the cameras'
+  phases, so each camera contributes at most one frame to a set and the
+  frames of a set are as close together as the free-running cameras
+  allow. A set goes out as soon as every camera either contributed or is
+  known to have skipped it (its next frame is already later), otherwise
+  latency nanoseconds after the set's center at the latest. Sets with
+  fewer than min_cameras cameras are dropped, frames arriving after their
+  set went out are discarded as late.
+*/
+
+struct sync_set {
+	struct triangulate_set set;  // timestamp is the set's center, views of missing cameras are empty
+	uint32_t present;            // bit k set if camera k contributed
+	uint32_t sequence[TRIANGULATE_MAX_CAMERAS];  // driver frame numbers
+	uint64_t timestamp[TRIANGULATE_MAX_CAMERAS]; // filtered driver timestamps
+};
+
+struct sync_clock {
+	double period;  // ns between frames
+	double drift;   // ppm, rate against the average of all cameras
+	double offset;  // ns, average position of the camera's frames relative to their set's center
+	double jitter;  // ns, average deviation of the raw timestamps from the filter
+};
+
+struct sync_stats {
+	uint64_t sets;      // sets delivered
+	uint64_t partial;   // ... of which some camera was missing from
+	uint64_t dropped;   // sets with less than min_cameras cameras
+	uint64_t late;      // frames discarded because their set was gone
+	uint64_t overflow;  // frames sync_push() couldn't queue
+	uint64_t resync;    // filter restarts after a jump in a camera's timestamps
+};
+
+struct synchronizer;
+
+struct synchronizer* sync_create(int cameras, uint64_t latency, int min_cameras);
+
+// from camera's capture thread, never blocks: -1 if its queue is full
+int sync_push(struct synchronizer* sync, int camera, const struct optitrack_frame* header,
+	const struct optitrack_centroid* centroids, int count);
+
+// from one consumer thread: 1 and a set in out, or 0 if none is due at time now
+int sync_poll(struct synchronizer* sync, uint64_t now, struct sync_set* out);
+
+// from the consumer thread
+void sync_get_clock(struct synchronizer* sync, int camera, struct sync_clock* out);
+void sync_get_stats(struct synchronizer* sync, struct sync_stats* out);
+
+void sync_destroy(struct synchronizer* sync);
+
+#endif
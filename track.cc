@@ -0,0 +1,619 @@
+/* NaturalPoint Optitrack rigid-body tracking
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <math.h>   // sqrt() etc.
+#include <string.h> // memset()
+
+#include <algorithm>
+
+#include "track.h"
+
+// Kalman filter: acceleration noise in mm/s^2, measurement noise in mm
+#define ACCELERATION 5000.0
+#define MEASUREMENT  1.0
+
+// velocity uncertainty of a body just found, mm/s
+#define INITIAL_SPEED 1000.0
+
+// gates grow with the position uncertainty, up to this many times the base
+#define GATE_SIGMAS 3.0
+#define GATE_LIMIT  4.0
+
+// fits with a larger rms residual than this many times the measurement noise are wrong
+#define RESIDUAL_LIMIT 3.0
+
+// ... and so are fits further from the prediction than this many standard deviations
+#define INNOVATION_SIGMAS 4.0
+
+// frame time until two timestamps are known, 100 fps
+#define DEFAULT_DT 0.01
+
+// spatial hash over the points of a frame, cells twice the base gate
+#define BUCKETS 256
+#define CELL    2.0
+
+// marker and point close enough to belong together, gated update only
+#define MAX_PAIRS 4096
+
+struct pairing {
+	double distance;
+	short body, marker, point;
+};
+
+struct body {
+
+	int count;
+	double marker[TRACK_MAX_MARKERS][3];
+
+	// distances between all markers, for the full search
+	double distance[TRACK_MAX_MARKERS][TRACK_MAX_MARKERS];
+
+	// per axis position, velocity and covariance p00, p01, p11
+	double x[3], v[3], P[3][3];
+
+	// prediction for the current frame and the radius of its gates
+	double xp[3], qp[4], radius;
+
+	// orientation and angular velocity (axis times rad/s)
+	double q[4], omega[3];
+
+	int tracked, missed, markers;
+	double error;
+	short point[TRACK_MAX_MARKERS];
+};
+
+struct tracker {
+
+	double gate;
+	int lost;
+
+	int count;
+	body bodies[TRACK_MAX_BODIES];
+
+	uint64_t last; // timestamp of the previous frame
+	bool started;
+
+	// points of the current frame, bucketed by cells
+	const triangulate_result* points;
+	int head[BUCKETS], next[TRIANGULATE_MAX_POINTS];
+	bool claimed[TRIANGULATE_MAX_POINTS];
+
+	pairing pairs[MAX_PAIRS];
+	int pair_count;
+
+	track_stats stats;
+};
+
+
+// quaternions, w x y z
+
+static void qmul(const double* a, const double* b, double* out) {
+	double r[4] = {
+		a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3],
+		a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2],
+		a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1],
+		a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0] };
+	for (int i = 0; i < 4; i++) out[i] = r[i];
+}
+
+static void rotate(const double* q, const double* v, double* out) {
+	double p[4] = { 0, v[0], v[1], v[2] }, c[4] = { q[0], -q[1], -q[2], -q[3] }, t[4];
+	qmul(q,p,t); qmul(t,c,t);
+	for (int i = 0; i < 3; i++) out[i] = t[i+1];
+}
+
+// rotation by the vector a, its length is the angle
+static void from_axis(const double* a, double* q) {
+	double angle = sqrt(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
+	double s = (angle > 1e-12) ? sin(angle / 2) / angle : 0.5;
+	q[0] = cos(angle / 2); q[1] = a[0] * s; q[2] = a[1] * s; q[3] = a[2] * s;
+}
+
+static void to_axis(const double* q, double* a) {
+	double w = q[0] < 0 ? -1 : 1; // shortest way round
+	double s = sqrt(q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+	double angle = 2 * atan2(s,w * q[0]);
+	double f = (s > 1e-12) ? w * angle / s : 2;
+	for (int i = 0; i < 3; i++) a[i] = q[i+1] * f;
+}
+
+
+/*
+  Horn's closed form: the rotation taking the centered body markers onto
+  the centered points is the eigenvector of the largest eigenvalue of a
+  symmetric 4x4 matrix built from their cross-covariance. Found with
+  Jacobi rotations, which is plenty fast for a 4x4 matrix.
+*/
+static void eigen4(double a[4][4], double v[4][4], double d[4]) {
+
+	for (int i = 0; i < 4; i++) for (int j = 0; j < 4; j++) v[i][j] = (i == j);
+
+	for (int sweep = 0; sweep < 32; sweep++) {
+
+		double off = 0;
+		for (int i = 0; i < 4; i++) for (int j = i + 1; j < 4; j++) off += a[i][j] * a[i][j];
+		if (off < 1e-20) break;
+
+		for (int p = 0; p < 4; p++)
+		for (int q = p + 1; q < 4; q++) {
+			if (fabs(a[p][q]) < 1e-30) continue;
+			double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+			double t = ((theta >= 0) ? 1 : -1) / (fabs(theta) + sqrt(theta*theta + 1));
+			double c = 1 / sqrt(t*t + 1), s = t * c;
+			for (int k = 0; k < 4; k++) {
+				double akp = a[k][p], akq = a[k][q];
+				a[k][p] = c*akp - s*akq; a[k][q] = s*akp + c*akq;
+			}
+			for (int k = 0; k < 4; k++) {
+				double apk = a[p][k], aqk = a[q][k];
+				a[p][k] = c*apk - s*aqk; a[q][k] = s*apk + c*aqk;
+			}
+			for (int k = 0; k < 4; k++) {
+				double vkp = v[k][p], vkq = v[k][q];
+				v[k][p] = c*vkp - s*vkq; v[k][q] = s*vkp + c*vkq;
+			}
+		}
+	}
+
+	for (int i = 0; i < 4; i++) d[i] = a[i][i];
+}
+
+// pose taking body markers m onto world points w, returns the rms residual
+static double fit(const double (*m)[3], const double (*w)[3], int n, double* q, double* x) {
+
+	double mc[3] = { 0 }, wc[3] = { 0 }, S[3][3] = { { 0 } };
+
+	for (int i = 0; i < n; i++) for (int k = 0; k < 3; k++) { mc[k] += m[i][k] / n; wc[k] += w[i][k] / n; }
+
+	for (int i = 0; i < n; i++)
+		for (int a = 0; a < 3; a++) for (int b = 0; b < 3; b++)
+			S[a][b] += (m[i][a] - mc[a]) * (w[i][b] - wc[b]);
+
+	double N[4][4] = {
+		{ S[0][0]+S[1][1]+S[2][2], S[1][2]-S[2][1],          S[2][0]-S[0][2],          S[0][1]-S[1][0]          },
+		{ S[1][2]-S[2][1],          S[0][0]-S[1][1]-S[2][2], S[0][1]+S[1][0],          S[2][0]+S[0][2]          },
+		{ S[2][0]-S[0][2],          S[0][1]+S[1][0],          -S[0][0]+S[1][1]-S[2][2], S[1][2]+S[2][1]          },
+		{ S[0][1]-S[1][0],          S[2][0]+S[0][2],          S[1][2]+S[2][1],          -S[0][0]-S[1][1]+S[2][2] } };
+
+	double V[4][4], d[4];
+	eigen4(N,V,d);
+
+	int best = 0;
+	for (int i = 1; i < 4; i++) if (d[i] > d[best]) best = i;
+	double norm = 0;
+	for (int i = 0; i < 4; i++) { q[i] = V[i][best]; norm += q[i] * q[i]; }
+	for (int i = 0; i < 4; i++) q[i] /= sqrt(norm);
+
+	double r[3], sum = 0;
+	rotate(q,mc,r);
+	for (int k = 0; k < 3; k++) x[k] = wc[k] - r[k];
+
+	for (int i = 0; i < n; i++) {
+		rotate(q,m[i],r);
+		for (int k = 0; k < 3; k++) { double e = r[k] + x[k] - w[i][k]; sum += e * e; }
+	}
+
+	return sqrt(sum / n);
+}
+
+
+// spatial hash
+
+static int bucket(int cx, int cy, int cz) {
+	return (unsigned int)(cx * 73856093 ^ cy * 19349663 ^ cz * 83492791) % BUCKETS;
+}
+
+static void cell(const tracker* tr, const double* p, int* c) {
+	for (int k = 0; k < 3; k++) c[k] = (int)floor(p[k] / (tr->gate * CELL));
+}
+
+static void index_points(tracker* tr, const triangulate_result* points) {
+
+	tr->points = points;
+	for (int b = 0; b < BUCKETS; b++) tr->head[b] = -1;
+
+	for (int i = 0; i < points->count; i++) {
+		const triangulate_point& p = points->points[i];
+		double pos[3] = { p.x, p.y, p.z };
+		int c[3];
+		cell(tr,pos,c);
+		int b = bucket(c[0],c[1],c[2]);
+		tr->next[i] = tr->head[b];
+		tr->head[b] = i;
+		tr->claimed[i] = false;
+	}
+}
+
+// nearest unclaimed point within radius of p, -1 if there is none
+static int nearest(const tracker* tr, const double* p, double radius) {
+
+	int c[3], best = -1, reach = (int)ceil(radius / (tr->gate * CELL));
+	double limit = radius * radius;
+	cell(tr,p,c);
+
+	for (int dx = -reach; dx <= reach; dx++)
+	for (int dy = -reach; dy <= reach; dy++)
+	for (int dz = -reach; dz <= reach; dz++)
+		for (int i = tr->head[bucket(c[0]+dx,c[1]+dy,c[2]+dz)]; i >= 0; i = tr->next[i]) {
+			if (tr->claimed[i]) continue;
+			const triangulate_point& q = tr->points->points[i];
+			double d = (q.x-p[0])*(q.x-p[0]) + (q.y-p[1])*(q.y-p[1]) + (q.z-p[2])*(q.z-p[2]);
+			if (d < limit) { limit = d; best = i; }
+		}
+
+	return best;
+}
+
+// remember every unclaimed point within radius of marker m of body i at p
+static void candidates(tracker* tr, int i, int m, const double* p, double radius) {
+
+	int c[3], reach = (int)ceil(radius / (tr->gate * CELL));
+	double limit = radius * radius;
+	cell(tr,p,c);
+
+	for (int dx = -reach; dx <= reach; dx++)
+	for (int dy = -reach; dy <= reach; dy++)
+	for (int dz = -reach; dz <= reach; dz++)
+		for (int j = tr->head[bucket(c[0]+dx,c[1]+dy,c[2]+dz)]; j >= 0; j = tr->next[j]) {
+			if (tr->claimed[j] || tr->pair_count == MAX_PAIRS) continue;
+			const triangulate_point& q = tr->points->points[j];
+			double d = (q.x-p[0])*(q.x-p[0]) + (q.y-p[1])*(q.y-p[1]) + (q.z-p[2])*(q.z-p[2]);
+			if (d >= limit) continue;
+			pairing& pr = tr->pairs[tr->pair_count++];
+			pr.distance = d; pr.body = i; pr.marker = m; pr.point = j;
+		}
+}
+
+static void position(const triangulate_result* points, int i, double* out) {
+	out[0] = points->points[i].x; out[1] = points->points[i].y; out[2] = points->points[i].z;
+}
+
+/*
+  Match every marker of b at pose (q,x) within radius, claiming the
+  points, and refit the pose to them. Returns the number matched, the
+  claims are undone if the fit is rejected (fewer than need markers or
+  a residual beyond RESIDUAL_LIMIT).
+*/
+static int match(tracker* tr, body& b, const double* q, const double* x, double radius, int need, double* fq, double* fx, double* error) {
+
+	double m[TRACK_MAX_MARKERS][3], w[TRACK_MAX_MARKERS][3];
+	int n = 0;
+
+	for (int i = 0; i < b.count; i++) {
+		double p[3];
+		rotate(q,b.marker[i],p);
+		for (int k = 0; k < 3; k++) p[k] += x[k];
+		int j = nearest(tr,p,radius);
+		b.point[i] = j;
+		if (j < 0) continue;
+		tr->claimed[j] = true;
+		for (int k = 0; k < 3; k++) m[n][k] = b.marker[i][k];
+		position(tr->points,j,w[n]);
+		n++;
+	}
+
+	*error = (n >= 3) ? fit(m,w,n,fq,fx) : INFINITY;
+
+	if (n < need || *error > RESIDUAL_LIMIT * MEASUREMENT) {
+		for (int i = 0; i < b.count; i++) {
+			if (b.point[i] >= 0) tr->claimed[b.point[i]] = false;
+			b.point[i] = -1;
+		}
+		return 0;
+	}
+
+	return n;
+}
+
+static void start_track(tracker* tr, body& b, const double* q, const double* x) {
+	for (int k = 0; k < 3; k++) {
+		b.x[k] = x[k]; b.v[k] = 0; b.omega[k] = 0;
+		b.P[k][0] = MEASUREMENT * MEASUREMENT; b.P[k][1] = 0; b.P[k][2] = INITIAL_SPEED * INITIAL_SPEED;
+	}
+	for (int i = 0; i < 4; i++) b.q[i] = q[i];
+	b.tracked = 1;
+	b.missed = 0;
+}
+
+/*
+  Every pair of free points whose distance fits some pair of markers a, b
+  of the body, and every third point that fits a marker c further down
+  the list than both, gives a candidate pose. Any three visible markers
+  can seed the search that way, each triangle of markers only once.
+*/
+static bool search(tracker* tr, body& b) {
+
+	const triangulate_result* points = tr->points;
+	double tolerance = tr->gate / 2;
+	double best_q[4], best_x[3], best_error = INFINITY;
+	int best = 0, need = (b.count < 4) ? b.count : 4;
+
+	tr->stats.searched++;
+
+	// all markers within the noise can't be beaten, a mirrored assignment fits worse
+	auto done = [&] { return best == b.count && best_error < MEASUREMENT; };
+
+	for (int p = 0; p < points->count && !done(); p++) {
+		if (tr->claimed[p]) continue;
+		double P[3]; position(points,p,P);
+
+		for (int q = 0; q < points->count && !done(); q++) {
+			if (q == p || tr->claimed[q]) continue;
+			double Q[3]; position(points,q,Q);
+			double pq = sqrt((P[0]-Q[0])*(P[0]-Q[0]) + (P[1]-Q[1])*(P[1]-Q[1]) + (P[2]-Q[2])*(P[2]-Q[2]));
+
+			for (int a = 0; a < b.count; a++)
+			for (int c = a + 1; c < b.count; c++) {
+				if (fabs(pq - b.distance[a][c]) > tolerance) continue;
+
+				for (int r = 0; r < points->count; r++) {
+					if (r == p || r == q || tr->claimed[r]) continue;
+					double Rp[3]; position(points,r,Rp);
+					double pr = sqrt((P[0]-Rp[0])*(P[0]-Rp[0]) + (P[1]-Rp[1])*(P[1]-Rp[1]) + (P[2]-Rp[2])*(P[2]-Rp[2]));
+					double qr = sqrt((Q[0]-Rp[0])*(Q[0]-Rp[0]) + (Q[1]-Rp[1])*(Q[1]-Rp[1]) + (Q[2]-Rp[2])*(Q[2]-Rp[2]));
+
+					for (int d = c + 1; d < b.count; d++) {
+						if (fabs(pr - b.distance[a][d]) > tolerance || fabs(qr - b.distance[c][d]) > tolerance) continue;
+
+						double m[3][3], w[3][3], cq[4], cx[3], fq[4], fx[3], error;
+						for (int k = 0; k < 3; k++) {
+							m[0][k] = b.marker[a][k]; m[1][k] = b.marker[c][k]; m[2][k] = b.marker[d][k];
+							w[0][k] = P[k]; w[1][k] = Q[k]; w[2][k] = Rp[k];
+						}
+						fit(m,w,3,cq,cx);
+
+						// see how many markers the candidate explains, then let the points go again
+						int n = match(tr,b,cq,cx,tr->gate,need,fq,fx,&error);
+						for (int i = 0; i < b.count; i++) if (b.point[i] >= 0) tr->claimed[b.point[i]] = false;
+
+						if (n > best || (n == best && error < best_error)) {
+							best = n; best_error = error;
+							for (int i = 0; i < 4; i++) best_q[i] = fq[i];
+							for (int k = 0; k < 3; k++) best_x[k] = fx[k];
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (!best) return false;
+
+	// claim the points of the winner for good
+	double fq[4], fx[3];
+	b.markers = match(tr,b,best_q,best_x,tr->gate,need,fq,fx,&b.error);
+	if (!b.markers) return false;
+
+	start_track(tr,b,fq,fx);
+	tr->stats.found++;
+	return true;
+}
+
+// where the body will be, and how far out to look for its markers
+static void predict(tracker* tr, body& b, double dt) {
+
+	double step[3], dq[4], radius = 0;
+
+	// constant velocity, Q from white acceleration noise
+	double qa = ACCELERATION * ACCELERATION;
+	for (int k = 0; k < 3; k++) {
+		double* P = b.P[k];
+		b.xp[k] = b.x[k] + b.v[k] * dt;
+		double p00 = P[0] + 2*dt*P[1] + dt*dt*P[2] + qa * dt*dt*dt*dt / 4;
+		double p01 = P[1] + dt*P[2] + qa * dt*dt*dt / 2;
+		double p11 = P[2] + qa * dt*dt;
+		P[0] = p00; P[1] = p01; P[2] = p11;
+		if (p00 > radius) radius = p00;
+	}
+
+	for (int k = 0; k < 3; k++) step[k] = b.omega[k] * dt;
+	from_axis(step,dq);
+	qmul(dq,b.q,b.qp);
+
+	b.radius = tr->gate + GATE_SIGMAS * sqrt(radius);
+	if (b.radius > tr->gate * GATE_LIMIT) b.radius = tr->gate * GATE_LIMIT;
+}
+
+// fit the pose to the points assigned to the markers, then correct the filter
+static void correct(tracker* tr, body& b, double dt) {
+
+	double m[TRACK_MAX_MARKERS][3], w[TRACK_MAX_MARKERS][3], fq[4], fx[3], error = INFINITY;
+	int n = 0;
+
+	for (int i = 0; i < b.count; i++) {
+		if (b.point[i] < 0) continue;
+		for (int k = 0; k < 3; k++) m[n][k] = b.marker[i][k];
+		position(tr->points,b.point[i],w[n]);
+		n++;
+	}
+
+	if (n >= 3) error = fit(m,w,n,fq,fx);
+
+	// three markers with a stray point among them can still fit well, but not where the body should be
+	bool off = false;
+	for (int k = 0; k < 3 && n >= 3; k++) {
+		double r = fx[k] - b.xp[k];
+		if (r * r > INNOVATION_SIGMAS * INNOVATION_SIGMAS * (b.P[k][0] + MEASUREMENT * MEASUREMENT)) off = true;
+	}
+
+	if (n < 3 || error > RESIDUAL_LIMIT * MEASUREMENT || off) {
+		// let the points go and coast on the prediction
+		for (int i = 0; i < b.count; i++) {
+			if (b.point[i] >= 0) tr->claimed[b.point[i]] = false;
+			b.point[i] = -1;
+		}
+		for (int k = 0; k < 3; k++) b.x[k] = b.xp[k];
+		for (int i = 0; i < 4; i++) b.q[i] = b.qp[i];
+		b.markers = 0;
+		if (++b.missed >= tr->lost) { b.tracked = 0; tr->stats.lost++; }
+		return;
+	}
+
+	tr->stats.gated++;
+
+	double R = MEASUREMENT * MEASUREMENT;
+	for (int k = 0; k < 3; k++) {
+		double* P = b.P[k];
+		double s = P[0] + R, k0 = P[0] / s, k1 = P[1] / s, r = fx[k] - b.xp[k];
+		b.x[k] = b.xp[k] + k0 * r;
+		b.v[k] += k1 * r;
+		double p00 = (1 - k0) * P[0], p01 = (1 - k0) * P[1], p11 = P[2] - k1 * P[1];
+		P[0] = p00; P[1] = p01; P[2] = p11;
+	}
+
+	// angular velocity from the last rotation step, smoothed
+	double conj[4] = { b.q[0], -b.q[1], -b.q[2], -b.q[3] }, turn[4], axis[3];
+	qmul(fq,conj,turn);
+	to_axis(turn,axis);
+	for (int k = 0; k < 3; k++) b.omega[k] += (axis[k] / dt - b.omega[k]) * 0.5;
+
+	for (int i = 0; i < 4; i++) b.q[i] = fq[i];
+	b.markers = n;
+	b.error = error;
+	b.missed = 0;
+}
+
+/*
+  Gated update of all tracked bodies at once: every marker near a point
+  is a candidate pairing, and the pairings are handed out closest first,
+  each point and each marker only once. A point in the gates of two
+  bodies goes to the one that predicted it best, whatever their order.
+*/
+static void update(tracker* tr, double dt) {
+
+	tr->pair_count = 0;
+
+	for (int i = 0; i < tr->count; i++) {
+		body& b = tr->bodies[i];
+		for (int m = 0; m < b.count; m++) b.point[m] = -1;
+		if (!b.tracked) continue;
+		predict(tr,b,dt);
+		for (int m = 0; m < b.count; m++) {
+			double p[3];
+			rotate(b.qp,b.marker[m],p);
+			for (int k = 0; k < 3; k++) p[k] += b.xp[k];
+			candidates(tr,i,m,p,b.radius);
+		}
+	}
+
+	std::sort(tr->pairs,tr->pairs + tr->pair_count,[](const pairing& a, const pairing& b) { return a.distance < b.distance; });
+
+	for (int n = 0; n < tr->pair_count; n++) {
+		const pairing& pr = tr->pairs[n];
+		short& point = tr->bodies[pr.body].point[pr.marker];
+		if (tr->claimed[pr.point] || point >= 0) continue;
+		point = pr.point;
+		tr->claimed[pr.point] = true;
+	}
+
+	for (int i = 0; i < tr->count; i++)
+		if (tr->bodies[i].tracked) correct(tr,tr->bodies[i],dt);
+}
+
+int track_update(tracker* tr, const triangulate_result* points) {
+
+	double dt = DEFAULT_DT;
+	if (tr->started && points->timestamp > tr->last) dt = (points->timestamp - tr->last) / 1e9;
+	tr->last = points->timestamp;
+	tr->started = true;
+	tr->stats.frames++;
+
+	index_points(tr,points);
+
+	// tracked bodies first, so a search only sees the points nobody claimed
+	update(tr,dt);
+
+	int tracked = 0;
+	for (int i = 0; i < tr->count; i++) {
+		body& b = tr->bodies[i];
+		if (!b.tracked) search(tr,b);
+		tracked += b.tracked;
+	}
+
+	return tracked;
+}
+
+int track_add_body(tracker* tr, const float markers[][3], int count) {
+
+	if (tr->count == TRACK_MAX_BODIES || count < 3 || count > TRACK_MAX_MARKERS) return -1;
+
+	body& b = tr->bodies[tr->count];
+	memset(&b,0,sizeof(b));
+	b.count = count;
+	for (int i = 0; i < count; i++) for (int k = 0; k < 3; k++) b.marker[i][k] = markers[i][k];
+	for (int i = 0; i < TRACK_MAX_MARKERS; i++) b.point[i] = -1;
+	b.q[0] = 1;
+
+	for (int i = 0; i < count; i++)
+		for (int j = 0; j < count; j++) {
+			double d = 0;
+			for (int k = 0; k < 3; k++) d += (b.marker[i][k] - b.marker[j][k]) * (b.marker[i][k] - b.marker[j][k]);
+			b.distance[i][j] = sqrt(d);
+		}
+
+	return tr->count++;
+}
+
+int track_register(tracker* tr, const triangulate_result* points, const int* indices, int count) {
+
+	float markers[TRACK_MAX_MARKERS][3];
+	double center[3] = { 0, 0, 0 }, q[4] = { 1, 0, 0, 0 };
+
+	if (count < 3 || count > TRACK_MAX_MARKERS) return -1;
+
+	for (int i = 0; i < count; i++) {
+		double p[3];
+		position(points,indices[i],p);
+		for (int k = 0; k < 3; k++) center[k] += p[k] / count;
+	}
+
+	for (int i = 0; i < count; i++) {
+		double p[3];
+		position(points,indices[i],p);
+		for (int k = 0; k < 3; k++) markers[i][k] = p[k] - center[k];
+	}
+
+	int id = track_add_body(tr,markers,count);
+	if (id >= 0) start_track(tr,tr->bodies[id],q,center);
+	return id;
+}
+
+void track_reset(tracker* tr) {
+	for (int i = 0; i < tr->count; i++) tr->bodies[i].tracked = 0;
+}
+
+void track_get_body(tracker* tr, int id, track_body* out) {
+
+	const body& b = tr->bodies[id];
+
+	out->tracked = b.tracked;
+	out->markers = b.markers;
+	out->missed = b.missed;
+	out->error = b.error;
+	for (int k = 0; k < 3; k++) { out->position[k] = b.x[k]; out->velocity[k] = b.v[k]; }
+	for (int i = 0; i < 4; i++) out->rotation[i] = b.q[i];
+	for (int i = 0; i < TRACK_MAX_MARKERS; i++) out->point[i] = (i < b.count) ? b.point[i] : -1;
+}
+
+void track_get_stats(tracker* tr, track_stats* out) {
+	*out = tr->stats;
+}
+
+tracker* track_create(float gate, int lost) {
+	tracker* tr = new tracker();
+	tr->gate = gate;
+	tr->lost = (lost < 1) ? 1 : lost;
+	return tr;
+}
+
+void track_destroy(tracker* tr) {
+	delete tr;
+}
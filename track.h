@@ -0,0 +1,84 @@
+/* NaturalPoint Optitrack rigid-body tracking
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _TRACK_H
+#define _TRACK_H
+
+#include <stdint.h>
+
+#include "triangulate.h"
+
+#define TRACK_MAX_BODIES  16
+#define TRACK_MAX_MARKERS 8 // per body
+
+/*
+  A body is a rigid constellation of at least three markers, given in
+  its own coordinates. While a body is tracked, a constant-velocity
+  Kalman filter per axis predicts its position and the last rotation
+  step predicts its orientation; every marker is then looked up only
+  within a gate around its predicted position, which grows with the
+  filter's uncertainty. A point in the gates of several markers goes
+  to the closest one. The pose is fitted to the matched markers by
+  least squares (Horn's quaternion method), so the cost per frame is
+  linear in the number of markers. Fits with a residual beyond a few
+  times the noise, or too far from the prediction, are not taken.
+
+  Bodies not seen in lost frames in a row (or never found) go back to
+  a full search: every pair and third point whose distances match
+  three markers of the body gives a candidate pose, the one that
+  explains the most markers wins. Without a prediction three markers
+  are too easily explained by the wrong points, so a search needs four
+  (all of them on bodies with three). That is cubic in the number of
+  free points.
+*/
+
+struct track_body {
+	int tracked;            // 1 while the pose is valid
+	int markers;            // markers matched in the last frame
+	int missed;             // frames in a row without a fit
+	float position[3];      // mm, of the body origin
+	float rotation[4];      // unit quaternion w, x, y, z, body to world
+	float velocity[3];      // mm per second
+	float error;            // rms distance of the matched markers to the fit, mm
+	short point[TRACK_MAX_MARKERS]; // index into the last result per marker, -1 if unmatched
+};
+
+struct track_stats {
+	uint64_t frames;
+	uint64_t gated;    // bodies updated from their predicted windows
+	uint64_t searched; // full searches for lost bodies
+	uint64_t found;    // ... that found them
+	uint64_t lost;     // tracks given up
+};
+
+struct tracker;
+
+// gate: base radius of the search windows in mm; lost: frames before a full search
+struct tracker* track_create(float gate, int lost);
+
+// add a body, markers in its own coordinates; returns its id or -1
+int track_add_body(struct tracker* tr, const float markers[][3], int count);
+
+// add a body from points of a triangulated frame, with its origin at their centroid
+int track_register(struct tracker* tr, const struct triangulate_result* points, const int* indices, int count);
+
+// match all bodies against the points of the next frame, returns the number tracked
+int track_update(struct tracker* tr, const struct triangulate_result* points);
+
+// full search for every body on the next update, e.g. after a jump in time
+void track_reset(struct tracker* tr);
+
+void track_get_body(struct tracker* tr, int id, struct track_body* out);
+void track_get_stats(struct tracker* tr, struct track_stats* out);
+
+void track_destroy(struct tracker* tr);
+
+#endif
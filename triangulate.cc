@@ -0,0 +1,345 @@
+/* NaturalPoint Optitrack multi-camera triangulation
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#include <math.h>   // sqrt() etc.
+#include <string.h> // memset()
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <vector>
+
+#include "triangulate.h"
+
+struct triangulator {
+
+	int cameras;
+	triangulate_camera camera[TRIANGULATE_MAX_CAMERAS];
+
+	// fundamental matrices, x_j^T F[i][j] x_i = 0 for matching blobs
+	float F[TRIANGULATE_MAX_CAMERAS][TRIANGULATE_MAX_CAMERAS][9];
+
+	float tolerance;
+	int min_views;
+
+	// workers for triangulate_frames(), woken by a new generation
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	unsigned int generation;
+	unsigned int finished;
+	bool quit;
+
+	// current batch
+	const triangulate_set* sets;
+	triangulate_result* results;
+	int count;
+	std::atomic<int> next;
+};
+
+// candidate point and the blobs supporting it
+struct candidate {
+	float X[3];
+	float error;
+	int views;
+	short blob[TRIANGULATE_MAX_CAMERAS];
+};
+
+static double det3(double m[3][3]) {
+	return m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1])
+	     - m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0])
+	     + m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+}
+
+static double det4(double m[4][4]) {
+	double result = 0;
+	for (int c = 0; c < 4; c++) {
+		double minor[3][3];
+		for (int i = 1; i < 4; i++)
+			for (int j = 0, k = 0; j < 4; j++)
+				if (j != c) minor[i-1][k++] = m[i][j];
+		result += ((c & 1) ? -1 : 1) * m[0][c] * det3(minor);
+	}
+	return result;
+}
+
+/*
+  F_ji = (-1)^(i+j) det [ A without row i ; B without row j ] for the
+  projection matrices A of the first and B of the second camera, see
+  Hartley & Zisserman, section 17.1.
+*/
+static void fundamental(const triangulate_camera* a, const triangulate_camera* b, float* F) {
+
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++) {
+			double m[4][4];
+			for (int r = 0, k = 0; r < 3; r++) if (r != i) { for (int c = 0; c < 4; c++) m[k][c] = a->P[r*4+c]; k++; }
+			for (int r = 0, k = 2; r < 3; r++) if (r != j) { for (int c = 0; c < 4; c++) m[k][c] = b->P[r*4+c]; k++; }
+			F[j*3+i] = (((i + j) & 1) ? -1 : 1) * det4(m);
+		}
+
+	// scale doesn't matter, keep it away from float limits
+	double norm = 0;
+	for (int k = 0; k < 9; k++) norm += (double)F[k] * F[k];
+	norm = sqrt(norm);
+	if (norm > 0) for (int k = 0; k < 9; k++) F[k] /= norm;
+}
+
+int triangulate_project(const triangulate_camera* camera, const float* X, float* x, float* y) {
+	const float* P = camera->P;
+	float w = P[8]*X[0] + P[9]*X[1] + P[10]*X[2] + P[11];
+	if (w <= 0) return 0;
+	*x = (P[0]*X[0] + P[1]*X[1] + P[2]*X[2] + P[3]) / w;
+	*y = (P[4]*X[0] + P[5]*X[1] + P[6]*X[2] + P[7]) / w;
+	return 1;
+}
+
+/*
+  Each view adds the rows u*P3 - P1 and v*P3 - P2 to A in A*(X,1) = 0.
+  With the last coordinate fixed to 1 this is an ordinary least squares
+  problem in X, solved through the 3x3 normal equations.
+*/
+static bool solve(const triangulator* tri, const triangulate_set* set, candidate* c) {
+
+	double M[3][3] = { { 0 } }, r[3] = { 0 };
+
+	for (int k = 0; k < tri->cameras; k++) {
+
+		if (c->blob[k] < 0) continue;
+
+		const float* P = tri->camera[k].P;
+		double u = set->views[k].x[c->blob[k]], v = set->views[k].y[c->blob[k]];
+
+		for (int row = 0; row < 2; row++) {
+			double p = (row == 0) ? u : v, a[4];
+			for (int i = 0; i < 4; i++) a[i] = p * P[8+i] - P[row*4+i];
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 3; j++) M[i][j] += a[i] * a[j];
+				r[i] -= a[i] * a[3];
+			}
+		}
+	}
+
+	double d = det3(M);
+	if (fabs(d) < 1e-12) return false;
+
+	for (int col = 0; col < 3; col++) {
+		double m[3][3];
+		for (int i = 0; i < 3; i++) for (int j = 0; j < 3; j++) m[i][j] = (j == col) ? r[i] : M[i][j];
+		c->X[col] = det3(m) / d;
+	}
+
+	return true;
+}
+
+// rms reprojection error over the views of c, or infinity if behind a camera
+static float error(const triangulator* tri, const triangulate_set* set, candidate* c) {
+
+	float sum = 0, x, y;
+
+	for (int k = 0; k < tri->cameras; k++) {
+		if (c->blob[k] < 0) continue;
+		if (!triangulate_project(&tri->camera[k],c->X,&x,&y)) return INFINITY;
+		float dx = x - set->views[k].x[c->blob[k]], dy = y - set->views[k].y[c->blob[k]];
+		sum += dx*dx + dy*dy;
+	}
+
+	return sqrt(sum / c->views);
+}
+
+// nearest unused blob within tolerance of (px,py), -1 if there is none
+static int nearest(const triangulate_view* view, const unsigned char* used, float px, float py, float tolerance) {
+
+	float d[OPTITRACK_MAX_BLOBS];
+	int best = -1;
+	float limit = tolerance * tolerance;
+
+	// plain loop over the arrays, the compiler turns it into vector code
+	for (int b = 0; b < view->count; b++) {
+		float dx = view->x[b] - px, dy = view->y[b] - py;
+		d[b] = dx*dx + dy*dy;
+	}
+
+	for (int b = 0; b < view->count; b++)
+		if (!used[b] && d[b] < limit) { limit = d[b]; best = b; }
+
+	return best;
+}
+
+static int frame(const triangulator* tri, const triangulate_set* set, triangulate_result* out) {
+
+	unsigned char used[TRIANGULATE_MAX_CAMERAS][OPTITRACK_MAX_BLOBS];
+	memset(used,0,sizeof(used));
+
+	out->timestamp = set->timestamp;
+	out->count = 0;
+
+	for (int i = 0; i < tri->cameras; i++)
+	for (int j = i + 1; j < tri->cameras; j++) {
+
+		const triangulate_view& vi = set->views[i];
+		const triangulate_view& vj = set->views[j];
+		const float* F = tri->F[i][j];
+
+		for (int a = 0; a < vi.count; a++) {
+
+			if (used[i][a]) continue;
+			if (out->count == TRIANGULATE_MAX_POINTS) return out->count;
+
+			// epipolar line of blob a in camera j, and every blob's distance to it
+			float l0 = F[0]*vi.x[a] + F[1]*vi.y[a] + F[2];
+			float l1 = F[3]*vi.x[a] + F[4]*vi.y[a] + F[5];
+			float l2 = F[6]*vi.x[a] + F[7]*vi.y[a] + F[8];
+			float scale = 1.0f / sqrtf(l0*l0 + l1*l1);
+			float d[OPTITRACK_MAX_BLOBS];
+
+			for (int b = 0; b < vj.count; b++)
+				d[b] = fabsf(l0*vj.x[b] + l1*vj.y[b] + l2) * scale;
+
+			candidate best = { { 0, 0, 0 }, INFINITY, 0, { 0 } };
+
+			for (int b = 0; b < vj.count; b++) {
+
+				if (used[j][b] || d[b] > tri->tolerance) continue;
+
+				candidate c;
+				for (int k = 0; k < tri->cameras; k++) c.blob[k] = -1;
+				c.blob[i] = a; c.blob[j] = b; c.views = 2;
+
+				if (!solve(tri,set,&c)) continue;
+				if (!isfinite(error(tri,set,&c))) continue;
+
+				// pick up the other cameras
+				for (int k = 0; k < tri->cameras; k++) {
+					float px, py;
+					if (k == i || k == j) continue;
+					if (!triangulate_project(&tri->camera[k],c.X,&px,&py)) continue;
+					int blob = nearest(&set->views[k],used[k],px,py,tri->tolerance);
+					if (blob >= 0) { c.blob[k] = blob; c.views++; }
+				}
+
+				if ((c.views > 2) && !solve(tri,set,&c)) continue;
+				c.error = error(tri,set,&c);
+
+				if ((c.views > best.views) || ((c.views == best.views) && (c.error < best.error)))
+					best = c;
+			}
+
+			if (best.views < tri->min_views || !(best.error < tri->tolerance)) continue;
+
+			triangulate_point& p = out->points[out->count++];
+			p.x = best.X[0]; p.y = best.X[1]; p.z = best.X[2];
+			p.error = best.error;
+			p.views = best.views;
+			for (int k = 0; k < TRIANGULATE_MAX_CAMERAS; k++) p.blob[k] = -1;
+			for (int k = 0; k < tri->cameras; k++) {
+				p.blob[k] = best.blob[k];
+				if (best.blob[k] >= 0) used[k][best.blob[k]] = 1;
+			}
+		}
+	}
+
+	return out->count;
+}
+
+int triangulate_frame(triangulator* tri, const triangulate_set* set, triangulate_result* out) {
+	return frame(tri,set,out);
+}
+
+
+// thread pool
+
+static void run(triangulator* tri) {
+	int k;
+	while ((k = tri->next++) < tri->count)
+		frame(tri,&tri->sets[k],&tri->results[k]);
+}
+
+static void worker(triangulator* tri) {
+
+	unsigned int seen = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> guard(tri->lock);
+			tri->wake.wait(guard,[&]{ return tri->quit || (tri->generation != seen); });
+			if (tri->quit) return;
+			seen = tri->generation;
+		}
+
+		run(tri);
+
+		{
+			std::lock_guard<std::mutex> guard(tri->lock);
+			tri->finished++;
+		}
+		tri->done.notify_one();
+	}
+}
+
+void triangulate_frames(triangulator* tri, const triangulate_set* sets, triangulate_result* out, int count) {
+
+	if (tri->workers.empty()) {
+		for (int k = 0; k < count; k++) frame(tri,&sets[k],&out[k]);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(tri->lock);
+		tri->sets = sets;
+		tri->results = out;
+		tri->count = count;
+		tri->next = 0;
+		tri->finished = 0;
+		tri->generation++;
+	}
+	tri->wake.notify_all();
+
+	run(tri);
+
+	std::unique_lock<std::mutex> guard(tri->lock);
+	tri->done.wait(guard,[&]{ return tri->finished == tri->workers.size(); });
+}
+
+triangulator* triangulate_create(const triangulate_camera* cameras, int count, float tolerance, int min_views, int threads) {
+
+	if (count < 2 || count > TRIANGULATE_MAX_CAMERAS) return 0;
+
+	triangulator* tri = new triangulator();
+
+	tri->cameras = count;
+	tri->tolerance = tolerance;
+	tri->min_views = (min_views < 2) ? 2 : min_views;
+
+	for (int i = 0; i < count; i++) tri->camera[i] = cameras[i];
+
+	for (int i = 0; i < count; i++)
+		for (int j = 0; j < count; j++)
+			if (i != j) fundamental(&cameras[i],&cameras[j],tri->F[i][j]);
+
+	for (int i = 1; i < threads; i++)
+		tri->workers.push_back(std::thread(worker,tri));
+
+	return tri;
+}
+
+void triangulate_destroy(triangulator* tri) {
+
+	{
+		std::lock_guard<std::mutex> guard(tri->lock);
+		tri->quit = true;
+	}
+	tri->wake.notify_all();
+
+	for (std::thread& t: tri->workers) t.join();
+	delete tri;
+}
@@ -0,0 +1,93 @@
+/* NaturalPoint Optitrack multi-camera triangulation
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of
+  the License, or (at your option) any later version.
+
+  Copyright (C) 2008 by Florian 'Floe' Echtler <floe@butterbrot.org>
+
+*/
+
+#ifndef _TRIANGULATE_H
+#define _TRIANGULATE_H
+
+#include <stdint.h>
+
+#include "optitrack.h"
+#include "centroid.h"
+
+#define TRIANGULATE_MAX_CAMERAS 16
+#define TRIANGULATE_MAX_POINTS  OPTITRACK_MAX_BLOBS
+
+// 3x4 projection matrix, row by row, from world coordinates to sensor pixels
+struct triangulate_camera {
+	float P[12];
+};
+
+// blob centers of one camera, kept as separate arrays so the searches vectorize
+struct triangulate_view {
+	int count;
+	float x[OPTITRACK_MAX_BLOBS];
+	float y[OPTITRACK_MAX_BLOBS];
+};
+
+// blobs seen by every camera at (about) the same time
+struct triangulate_set {
+	uint64_t timestamp;
+	struct triangulate_view views[TRIANGULATE_MAX_CAMERAS];
+};
+
+struct triangulate_point {
+	float x, y, z;
+	float error; // rms reprojection error over the views used, in pixels
+	int views;   // number of cameras that saw the point
+	short blob[TRIANGULATE_MAX_CAMERAS]; // index into each view, -1 if not seen there
+};
+
+struct triangulate_result {
+	uint64_t timestamp;
+	int count;
+	struct triangulate_point points[TRIANGULATE_MAX_POINTS];
+};
+
+static inline void triangulate_view_set(struct triangulate_view* view, const struct optitrack_centroid* centroids, int count) {
+	view->count = count;
+	for (int i = 0; i < count; i++) {
+		view->x[i] = centroids[i].x;
+		view->y[i] = centroids[i].y;
+	}
+}
+
+/*
+  Correspondences are searched camera pair by camera pair: for a blob in
+  the first camera, every unused blob in the second one within tolerance
+  pixels of its epipolar line gives a candidate point. The candidate is
+  projected into all other cameras and picks up the nearest unused blob
+  within tolerance there. The candidate seen by the most cameras (then
+  with the smallest error) is solved again by linear least squares (DLT)
+  over all of them, and accepted if at least min_views cameras support it.
+  Its blobs are not used again for this set.
+
+  With fewer than three cameras min_views should be 2, but pairs alone
+  can't tell real points from ghosts where epipolar lines cross.
+*/
+
+struct triangulator;
+
+// threads > 1 starts threads-1 workers for triangulate_frames()
+struct triangulator* triangulate_create(const struct triangulate_camera* cameras, int count,
+	float tolerance, int min_views, int threads);
+
+// one set, on the calling thread
+int triangulate_frame(struct triangulator* tri, const struct triangulate_set* set, struct triangulate_result* out);
+
+// count independent sets, spread over the workers and the calling thread
+void triangulate_frames(struct triangulator* tri, const struct triangulate_set* sets, struct triangulate_result* out, int count);
+
+void triangulate_destroy(struct triangulator* tri);
+
+// project a world point into a camera, 0 if it is behind the camera
+int triangulate_project(const struct triangulate_camera* camera, const float* point, float* x, float* y);
+
+#endif